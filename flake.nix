@@ -84,7 +84,7 @@ find_dependency(zstd)"
           src = ./.;
 
           nativeBuildInputs = [ pkgs.cmake ];
-          buildInputs = [ openzl pkgs.zstd pkgs.cli11 ];
+          buildInputs = [ openzl pkgs.zstd pkgs.cli11 pkgs.xz pkgs.zlib ];
 
           cmakeFlags = [
             "-DOPENZL_ROOT=${openzl}"
@@ -97,6 +97,8 @@ find_dependency(zstd)"
             pkgs.gcc
             pkgs.git
             pkgs.cli11
+            pkgs.xz
+            pkgs.zlib
             openzl
           ];
         };
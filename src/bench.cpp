@@ -0,0 +1,313 @@
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "checksum.h"
+#include "common.h"
+#include "compressor.h"
+#include "io.h"
+#include "json.h"
+#include "levels.h"
+#include "openzl/zl_compress.h"
+#include "tools/training/utils/thread_pool.h"
+#include "trace_codec.h"
+#include "trace_model.h"
+#include "transpose.h"
+
+namespace {
+
+struct BenchResult {
+    size_t chunkSize;
+    size_t threads;
+    size_t numChunks;
+    uint64_t compressedBytes;
+    double compressSeconds;
+    double decompressSeconds;
+    long peakRssKb;  // without the mapped trace
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Reset the kernel's peak RSS mark so each sweep point reports its own peak.
+// Best effort: without it the reported peak is the process-wide maximum.
+void resetPeakRss() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+}
+
+// A kB field of /proc/self/status, or -1 without procfs
+long statusKb(const std::string& field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind(field, 0) == 0) return std::stol(line.substr(field.size()));
+    }
+    return -1;
+}
+
+long peakRssKb() {
+    const long hwm = statusKb("VmHWM:");
+    if (hwm >= 0) return hwm;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Fault in every page of the mapped trace and return how much RSS it adds.
+// Resident for the whole sweep, it is a constant share of every peak.
+long residentTraceKb(const char* data, size_t size) {
+    const long before = statusKb("RssFile:");
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+    volatile char sink = 0;
+    for (size_t offset = 0; offset < size; offset += pageSize) sink = sink + data[offset];
+    const long after = statusKb("RssFile:");
+    return before >= 0 && after >= 0 ? std::max(after - before, 0L) : 0;
+}
+
+// Compress `size` bytes in chunks and decode them back, entirely in memory.
+// The fastest of `repeat` runs is kept for each direction. Each chunk decodes
+// into a pooled buffer checked against its slice of the input, so the peak
+// holds the chunks in flight rather than a second copy of the trace.
+BenchResult runPoint(openzl::Compressor& compressor, const char* data, size_t size,
+                     size_t chunkBytes, size_t threads, size_t repeat, long traceKb) {
+    tracezl::BufferPool buffers;
+    openzl::training::ThreadPool pool(threads);
+    std::vector<tracezl::PooledBuffer> frames;
+    double bestCompress = std::numeric_limits<double>::infinity();
+    double bestDecompress = std::numeric_limits<double>::infinity();
+
+    resetPeakRss();
+    for (size_t run = 0; run < repeat; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::future<tracezl::PooledBuffer>> compressed;
+        for (size_t offset = 0; offset < size; offset += chunkBytes) {
+            const char* src = data + offset;
+            const size_t n = std::min(chunkBytes, size - offset);
+            compressed.push_back(pool.run([&compressor, &buffers, src, n]() {
+                return tracezl::compressChunk(compressor, src, n, buffers);
+            }));
+        }
+        frames.clear();
+        for (auto& frame : compressed) frames.push_back(frame.get());
+        bestCompress = std::min(bestCompress, secondsSince(start));
+
+        start = std::chrono::steady_clock::now();
+        std::vector<std::future<void>> decodes;
+        for (size_t i = 0; i < frames.size(); ++i) {
+            const tracezl::PooledBuffer& frame = frames[i];
+            const char* src = data + i * chunkBytes;
+            const size_t n = std::min(chunkBytes, size - i * chunkBytes);
+            decodes.push_back(pool.run([&buffers, &frame, src, n, chunkBytes]() {
+                tracezl::PooledBuffer decoded = buffers.acquire(n);
+                if (tracezl::decompressChunk(decoded.data(), n, frame.data(), frame.size()) != n) {
+                    throw std::runtime_error("Decoded chunk has the wrong size");
+                }
+                if (std::memcmp(decoded.data(), src, n) != 0) {
+                    throw std::runtime_error("Round trip mismatch at chunk size " +
+                                             std::to_string(chunkBytes));
+                }
+            }));
+        }
+        for (auto& decode : decodes) decode.get();
+        bestDecompress = std::min(bestDecompress, secondsSince(start));
+    }
+
+    uint64_t compressedBytes = 0;
+    for (const tracezl::PooledBuffer& frame : frames) compressedBytes += frame.size();
+    return {.chunkSize = chunkBytes,
+            .threads = threads,
+            .numChunks = frames.size(),
+            .compressedBytes = compressedBytes,
+            .compressSeconds = bestCompress,
+            .decompressSeconds = bestDecompress,
+            .peakRssKb = peakRssKb() - traceKb};
+}
+
+struct KernelResult {
+    tracezl::SimdLevel level;
+    double splitSeconds;
+    double mergeSeconds;
+};
+
+// Time the field splitter alone, outside any graph: records to field streams
+// and back, on one thread, at every SIMD level the CPU runs. Each level must
+// emit the streams of the scalar kernels and rebuild the input exactly.
+std::vector<KernelResult> runKernels(tracezl::TraceFormat format, const char* data, size_t size,
+                                     size_t chunkBytes, size_t repeat) {
+    std::vector<KernelResult> results;
+    for (int level = 0; level <= (int)tracezl::detectSimdLevel(); ++level) {
+        results.push_back({.level = (tracezl::SimdLevel)level,
+                           .splitSeconds = std::numeric_limits<double>::infinity(),
+                           .mergeSeconds = std::numeric_limits<double>::infinity()});
+    }
+
+    tracezl::BufferPool buffers;
+    tracezl::PooledBuffer decoded = buffers.acquire(chunkBytes);
+    const size_t recordSize = tracezl::recordSize(format);
+    const tracezl::SimdLevel active = tracezl::simdLevel();
+    std::vector<uint64_t> reference;  // stream hashes of the scalar kernels
+    for (size_t run = 0; run < repeat; ++run) {
+        for (KernelResult& result : results) {
+            tracezl::setSimdLevel(result.level);
+            double splitSeconds = 0, mergeSeconds = 0;
+            size_t stream = 0;
+            for (size_t offset = 0; offset < size; offset += chunkBytes) {
+                const size_t n = std::min(chunkBytes, size - offset);
+                auto start = std::chrono::steady_clock::now();
+                tracezl::FieldStream streams[tracezl::MAX_TAGS];
+                const size_t numStreams =
+                    tracezl::splitFields(format, data + offset, n, buffers, streams);
+                splitSeconds += secondsSince(start);
+
+                tracezl::StreamView views[tracezl::MAX_TAGS] = {};
+                for (size_t i = 0; i < numStreams; ++i, ++stream) {
+                    const tracezl::PooledBuffer& buffer = streams[i].data;
+                    const uint64_t hash = tracezl::xxh64(buffer.data(), buffer.size());
+                    if (stream == reference.size()) reference.push_back(hash);
+                    if (reference[stream] != hash) {
+                        throw std::runtime_error(
+                            std::string("Field streams differ at SIMD level ") +
+                            tracezl::simdLevelName(result.level));
+                    }
+                    views[i] = {.data = buffer.data(),
+                                .numElts = buffer.size() / streams[i].eltWidth,
+                                .eltWidth = streams[i].eltWidth};
+                }
+
+                start = std::chrono::steady_clock::now();
+                tracezl::mergeFields(format, views, n / recordSize, tracezl::MODEL_ALL,
+                                     tracezl::kAllFields, decoded.data());
+                mergeSeconds += secondsSince(start);
+                if (std::memcmp(decoded.data(), data + offset, n) != 0) {
+                    throw std::runtime_error(std::string("Round trip mismatch at SIMD level ") +
+                                             tracezl::simdLevelName(result.level));
+                }
+            }
+            result.splitSeconds = std::min(result.splitSeconds, splitSeconds);
+            result.mergeSeconds = std::min(result.mergeSeconds, mergeSeconds);
+        }
+    }
+    tracezl::setSimdLevel(active);
+    return results;
+}
+
+}  // namespace
+
+void bench_trace(const std::string& trace_path, const std::string& config_path,
+                 const BenchOptions& options) {
+    // With --json, stdout carries only the report
+    std::ostream& log = options.json ? std::cerr : std::cout;
+
+    const std::string configData = tracezl::selectLevel(
+        tracezl::parseLevels(tracezl::loadConfig(config_path)), options.level).config;
+    auto compressor = tracezl::createCompressorFromSerialized(configData, options.format);
+    compressor->setParameter(openzl::CParam::FormatVersion, ZL_MAX_FORMAT_VERSION);
+
+    // Whole records only, so every sweep point sees the same input
+    tracezl::MappedFile trace(trace_path);
+    const size_t recordSize = tracezl::recordSize(options.format);
+    const size_t size = trace.size() / recordSize * recordSize;
+    if (size == 0) throw std::runtime_error("Trace holds no whole records");
+    trace.prefetch(0, size);
+    // Peaks are reported without the mapped input, so they show the working
+    // set of the chunk size and thread count being swept
+    const long traceKb = residentTraceKb(trace.data(), size);
+    log << "Input mapping: " << (traceKb >> 10) << " MB resident, left out of peak RSS"
+        << std::endl;
+
+    log << "Benchmarking " << trace_path << " (" << (size >> 20) << " MB, "
+        << tracezl::formatName(options.format) << ")..." << std::endl;
+
+    std::vector<BenchResult> results;
+    for (size_t chunkSize : options.chunk_sizes) {
+        const size_t chunkBytes = std::max<size_t>(chunkSize / recordSize, 1) * recordSize;
+        for (size_t threads : options.thread_counts) {
+            results.push_back(runPoint(*compressor, trace.data(), size, chunkBytes,
+                                       std::max<size_t>(threads, 1),
+                                       std::max<size_t>(options.repeat, 1), traceKb));
+        }
+    }
+    std::vector<KernelResult> kernels;
+    if (options.kernels) {
+        const size_t chunkBytes =
+            std::max<size_t>(options.chunk_sizes.front() / recordSize, 1) * recordSize;
+        kernels = runKernels(options.format, trace.data(), size, chunkBytes,
+                             std::max<size_t>(options.repeat, 1));
+    }
+
+    const double mb = size / 1e6;
+    if (options.json) {
+        std::ostringstream hash;
+        hash << std::hex << std::setw(16) << std::setfill('0')
+             << tracezl::xxh64(configData.data(), configData.size());
+
+        std::cout << "{\n"
+                  << "  \"trace\": " << tracezl::jsonQuote(trace_path) << ",\n"
+                  << "  \"config\": " << tracezl::jsonQuote(config_path) << ",\n"
+                  << "  \"config_xxh64\": \"" << hash.str() << "\",\n"
+                  << "  \"format\": \"" << tracezl::formatName(options.format) << "\",\n"
+                  << "  \"input_bytes\": " << size << ",\n"
+                  << "  \"repeat\": " << options.repeat << ",\n"
+                  << "  \"trace_rss_kb\": " << traceKb << ",\n"
+                  << "  \"results\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const BenchResult& r = results[i];
+            std::cout << (i ? "," : "") << "\n    {\"chunk_size\": " << r.chunkSize
+                      << ", \"threads\": " << r.threads << ", \"chunks\": " << r.numChunks
+                      << ", \"compressed_bytes\": " << r.compressedBytes
+                      << ", \"ratio\": " << (double)size / r.compressedBytes
+                      << ", \"compress_mbps\": " << mb / r.compressSeconds
+                      << ", \"decompress_mbps\": " << mb / r.decompressSeconds
+                      << ", \"peak_rss_kb\": " << r.peakRssKb << "}";
+        }
+        std::cout << "\n  ]";
+        if (options.kernels) {
+            std::cout << ",\n  \"kernels\": [";
+            for (size_t i = 0; i < kernels.size(); ++i) {
+                const KernelResult& k = kernels[i];
+                std::cout << (i ? "," : "") << "\n    {\"simd\": \""
+                          << tracezl::simdLevelName(k.level)
+                          << "\", \"split_mbps\": " << mb / k.splitSeconds
+                          << ", \"merge_mbps\": " << mb / k.mergeSeconds << "}";
+            }
+            std::cout << "\n  ]";
+        }
+        std::cout << "\n}" << std::endl;
+        return;
+    }
+
+    std::cout << std::left << std::setw(12) << "chunk_size" << std::setw(9) << "threads"
+              << std::setw(9) << "ratio" << std::setw(13) << "comp MB/s" << std::setw(13)
+              << "decomp MB/s"
+              << "peak RSS MB" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    for (const BenchResult& r : results) {
+        std::cout << std::setw(12) << r.chunkSize << std::setw(9) << r.threads << std::setw(9)
+                  << (double)size / r.compressedBytes << std::setw(13) << mb / r.compressSeconds
+                  << std::setw(13) << mb / r.decompressSeconds << r.peakRssKb / 1024.0
+                  << std::endl;
+    }
+    if (options.kernels) {
+        std::cout << std::endl
+                  << std::setw(12) << "simd" << std::setw(13) << "split MB/s"
+                  << "merge MB/s" << std::endl;
+        for (const KernelResult& k : kernels) {
+            std::cout << std::setw(12) << tracezl::simdLevelName(k.level) << std::setw(13)
+                      << mb / k.splitSeconds << mb / k.mergeSeconds << std::endl;
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#include "buffer_pool.h"
+
+#include <cstring>
+#include <utility>
+
+namespace tracezl {
+
+PooledBuffer::~PooledBuffer() {
+    if (pool_ && data_) pool_->release(*this);
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept
+    : pool_(std::exchange(other.pool_, nullptr)),
+      data_(std::move(other.data_)),
+      capacity_(std::exchange(other.capacity_, 0)),
+      size_(std::exchange(other.size_, 0)) {}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept {
+    if (this != &other) {
+        if (pool_ && data_) pool_->release(*this);
+        pool_ = std::exchange(other.pool_, nullptr);
+        data_ = std::move(other.data_);
+        capacity_ = std::exchange(other.capacity_, 0);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+void PooledBuffer::resize(size_t size) {
+    if (size > capacity_) {
+        std::unique_ptr<char[]> grown(new char[size]);
+        if (size_) std::memcpy(grown.get(), data_.get(), size_);
+        data_ = std::move(grown);
+        capacity_ = size;
+    }
+    size_ = size;
+}
+
+PooledBuffer BufferPool::acquire(size_t size) {
+    PooledBuffer buffer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Prefer the most recently returned buffer that is large enough;
+        // otherwise grow one rather than let small buffers pile up
+        size_t pick = free_.size();
+        for (size_t i = free_.size(); i-- > 0;) {
+            if (free_[i].capacity() >= size) {
+                pick = i;
+                break;
+            }
+        }
+        if (pick == free_.size() && !free_.empty()) pick = free_.size() - 1;
+        if (pick < free_.size()) {
+            buffer = std::move(free_[pick]);
+            if (pick != free_.size() - 1) free_[pick] = std::move(free_.back());
+            free_.pop_back();
+        }
+    }
+    buffer.pool_ = this;
+    buffer.size_ = 0;
+    buffer.resize(size);
+    return buffer;
+}
+
+void BufferPool::release(PooledBuffer& buffer) {
+    PooledBuffer returned;
+    returned.data_ = std::move(buffer.data_);
+    returned.capacity_ = std::exchange(buffer.capacity_, 0);
+    buffer.size_ = 0;
+    buffer.pool_ = nullptr;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(std::move(returned));
+}
+
+}  // namespace tracezl
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace tracezl {
+
+class BufferPool;
+
+// Byte buffer borrowed from a BufferPool and handed back on destruction.
+// Unlike std::string, growing it does not zero-fill, and shrinking keeps the
+// capacity for the next chunk.
+class PooledBuffer {
+public:
+    PooledBuffer() = default;
+    ~PooledBuffer();
+    PooledBuffer(PooledBuffer&& other) noexcept;
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+
+    char* data() { return data_.get(); }
+    const char* data() const { return data_.get(); }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return capacity_; }
+
+    // Grow or shrink, keeping the first min(size(), size) bytes. Allocates
+    // only when `size` exceeds the capacity.
+    void resize(size_t size);
+
+private:
+    friend class BufferPool;
+
+    BufferPool* pool_ = nullptr;
+    std::unique_ptr<char[]> data_;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+};
+
+// Free list of buffers shared by the chunk tasks of a pipeline. Once as many
+// buffers as there are chunks in flight have been created, acquire() reuses
+// them, so steady-state chunk processing does not touch the heap. Buffers may
+// be returned from any thread; the pool must outlive them.
+class BufferPool {
+public:
+    BufferPool() = default;
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // A buffer of `size` bytes with unspecified contents
+    PooledBuffer acquire(size_t size);
+
+private:
+    friend class PooledBuffer;
+    void release(PooledBuffer& buffer);
+
+    std::mutex mutex_;
+    std::vector<PooledBuffer> free_;
+};
+
+}  // namespace tracezl
@@ -5,6 +5,7 @@
 
 #define NUM_INSTR_DESTINATIONS 2
 #define NUM_INSTR_SOURCES 4
+#define NUM_INSTR_DESTINATIONS_SPARC 4
 
 // ChampSim trace instruction format
 // Size: 8 + 1 + 1 + 2 + 4 + 16 + 32 = 64 bytes
@@ -18,4 +19,17 @@ struct trace_instr_format_t {
     uint64_t source_memory[NUM_INSTR_SOURCES];              // input memory
 };
 
+// ChampSim CloudSuite trace instruction format
+// Size: 8 + 1 + 1 + 4 + 4 + (6 padding) + 32 + 32 + 2 + (6 padding) = 96 bytes
+struct cloudsuite_instr_format_t {
+    uint64_t ip;
+    uint8_t is_branch;
+    uint8_t branch_taken;
+    uint8_t destination_registers[NUM_INSTR_DESTINATIONS_SPARC];
+    uint8_t source_registers[NUM_INSTR_SOURCES];
+    uint64_t destination_memory[NUM_INSTR_DESTINATIONS_SPARC];
+    uint64_t source_memory[NUM_INSTR_SOURCES];
+    uint8_t asid[2];  // address space id
+};
+
 #endif  // CHAMPSIM_TRACE_H
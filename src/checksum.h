@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tracezl {
+
+// XXH64 of `size` bytes at `data`, bit-compatible with the reference xxHash
+// implementation so stored hashes can be checked with standard tools.
+uint64_t xxh64(const void* data, size_t size, uint64_t seed = 0);
+
+}  // namespace tracezl
@@ -0,0 +1,286 @@
+#include "chunk_reader.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#ifdef TRACEZL_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef TRACEZL_HAVE_LZMA
+#include <lzma.h>
+#endif
+
+namespace tracezl {
+
+namespace {
+
+constexpr unsigned char kGzipMagic[] = {0x1F, 0x8B};
+constexpr unsigned char kXzMagic[] = {0xFD, '7', 'z', 'X', 'Z', 0x00};
+constexpr size_t kMagicSize = sizeof(kXzMagic);
+
+// Compressed bytes are read from the stream in blocks of this size
+constexpr size_t kInputBlock = 1 << 20;
+
+// The compressed side of a decoder: the bytes consumed by codec detection,
+// then the rest of the stream block by block
+class InputBlocks {
+public:
+    InputBlocks(std::istream& in, std::string prefix) : in_(in), block_(std::move(prefix)) {}
+
+    // Next block of input; empty at the end of the stream
+    std::string_view next() {
+        if (!prefixTaken_) {
+            prefixTaken_ = true;
+            if (!block_.empty()) return block_;
+        }
+        block_.resize(kInputBlock);
+        in_.read(block_.data(), block_.size());
+        block_.resize(in_.gcount());
+        return block_;
+    }
+
+private:
+    std::istream& in_;
+    std::string block_;
+    bool prefixTaken_ = false;
+};
+
+}  // namespace
+
+InputCodec detectInputCodec(const void* data, size_t size) {
+    if (size >= sizeof(kXzMagic) && std::memcmp(data, kXzMagic, sizeof(kXzMagic)) == 0) {
+        return InputCodec::Xz;
+    }
+    if (size >= sizeof(kGzipMagic) && std::memcmp(data, kGzipMagic, sizeof(kGzipMagic)) == 0) {
+        return InputCodec::Gzip;
+    }
+    return InputCodec::None;
+}
+
+const char* inputCodecName(InputCodec codec) {
+    switch (codec) {
+        case InputCodec::Gzip:
+            return "gzip";
+        case InputCodec::Xz:
+            return "xz";
+        default:
+            return "none";
+    }
+}
+
+// Produces trace bytes from the input stream
+class ChunkSource {
+public:
+    virtual ~ChunkSource() = default;
+    // Fill `dst` with up to `size` bytes; fewer only at the end of the trace
+    virtual size_t read(char* dst, size_t size) = 0;
+};
+
+namespace {
+
+class RawSource final : public ChunkSource {
+public:
+    RawSource(std::istream& in, std::string prefix) : in_(in), prefix_(std::move(prefix)) {}
+
+    size_t read(char* dst, size_t size) override {
+        const size_t fromPrefix = std::min(size, prefix_.size() - prefixPos_);
+        std::memcpy(dst, prefix_.data() + prefixPos_, fromPrefix);
+        prefixPos_ += fromPrefix;
+        in_.read(dst + fromPrefix, size - fromPrefix);
+        return fromPrefix + in_.gcount();
+    }
+
+private:
+    std::istream& in_;
+    std::string prefix_;
+    size_t prefixPos_ = 0;
+};
+
+#ifdef TRACEZL_HAVE_ZLIB
+class GzipSource final : public ChunkSource {
+public:
+    GzipSource(std::istream& in, std::string prefix) : input_(in, std::move(prefix)) {
+        // Window bits 15 + 32: any window size, gzip or zlib header
+        if (inflateInit2(&strm_, 15 + 32) != Z_OK) {
+            throw std::runtime_error("Cannot initialize the gzip decoder");
+        }
+    }
+    ~GzipSource() override { inflateEnd(&strm_); }
+
+    size_t read(char* dst, size_t size) override {
+        size_t done = 0;
+        while (done < size && !finished_) {
+            if (strm_.avail_in == 0 && !refill()) {
+                throw std::runtime_error("Truncated gzip input");
+            }
+            // avail_out is 32 bits; large chunks are filled in pieces
+            const uInt room = (uInt)std::min<size_t>(size - done, UINT_MAX);
+            strm_.next_out = reinterpret_cast<Bytef*>(dst + done);
+            strm_.avail_out = room;
+            const int ret = inflate(&strm_, Z_NO_FLUSH);
+            done += room - strm_.avail_out;
+            if (ret == Z_STREAM_END) {
+                // Further members follow in files written by pigz or cat
+                if (strm_.avail_in == 0 && !refill()) {
+                    finished_ = true;
+                } else {
+                    inflateReset(&strm_);
+                }
+            } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                throw std::runtime_error(std::string("Corrupt gzip input: ") +
+                                         (strm_.msg ? strm_.msg : zError(ret)));
+            }
+        }
+        return done;
+    }
+
+private:
+    bool refill() {
+        const std::string_view block = input_.next();
+        strm_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(block.data()));
+        strm_.avail_in = block.size();
+        return !block.empty();
+    }
+
+    InputBlocks input_;
+    z_stream strm_ = {};
+    bool finished_ = false;
+};
+#endif
+
+#ifdef TRACEZL_HAVE_LZMA
+class XzSource final : public ChunkSource {
+public:
+    XzSource(std::istream& in, std::string prefix) : input_(in, std::move(prefix)) {
+        // Concatenated streams decode as one, as xz itself does
+        if (lzma_stream_decoder(&strm_, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+            throw std::runtime_error("Cannot initialize the xz decoder");
+        }
+    }
+    ~XzSource() override { lzma_end(&strm_); }
+
+    size_t read(char* dst, size_t size) override {
+        size_t done = 0;
+        while (done < size && !finished_) {
+            if (strm_.avail_in == 0 && !inputDone_) {
+                const std::string_view block = input_.next();
+                strm_.next_in = reinterpret_cast<const uint8_t*>(block.data());
+                strm_.avail_in = block.size();
+                inputDone_ = block.empty();
+            }
+            strm_.next_out = reinterpret_cast<uint8_t*>(dst + done);
+            strm_.avail_out = size - done;
+            const lzma_ret ret = lzma_code(&strm_, inputDone_ ? LZMA_FINISH : LZMA_RUN);
+            done = size - strm_.avail_out;
+            if (ret == LZMA_STREAM_END) {
+                finished_ = true;
+            } else if (ret == LZMA_BUF_ERROR && inputDone_) {
+                throw std::runtime_error("Truncated xz input");
+            } else if (ret != LZMA_OK) {
+                throw std::runtime_error("Corrupt xz input (liblzma error " +
+                                         std::to_string(ret) + ")");
+            }
+        }
+        return done;
+    }
+
+private:
+    InputBlocks input_;
+    lzma_stream strm_ = LZMA_STREAM_INIT;
+    bool inputDone_ = false;
+    bool finished_ = false;
+};
+#endif
+
+std::unique_ptr<ChunkSource> makeSource(InputCodec codec, std::istream& in, std::string prefix) {
+    switch (codec) {
+        case InputCodec::Gzip:
+#ifdef TRACEZL_HAVE_ZLIB
+            return std::make_unique<GzipSource>(in, std::move(prefix));
+#else
+            throw std::runtime_error("gzip input needs tracezl built with zlib");
+#endif
+        case InputCodec::Xz:
+#ifdef TRACEZL_HAVE_LZMA
+            return std::make_unique<XzSource>(in, std::move(prefix));
+#else
+            throw std::runtime_error("xz input needs tracezl built with liblzma");
+#endif
+        default:
+            return std::make_unique<RawSource>(in, std::move(prefix));
+    }
+}
+
+}  // namespace
+
+ChunkReader::ChunkReader(std::istream& in, size_t chunkBytes, BufferPool& pool,
+                         size_t firstChunkBytes)
+    : chunkBytes_(chunkBytes),
+      firstChunkBytes_(firstChunkBytes ? firstChunkBytes : chunkBytes),
+      pool_(pool) {
+    // The magic bytes are consumed here and replayed by the source
+    std::string prefix(kMagicSize, '\0');
+    in.read(prefix.data(), prefix.size());
+    prefix.resize(in.gcount());
+    codec_ = detectInputCodec(prefix.data(), prefix.size());
+
+    thread_ = std::thread(
+        [this, source = makeSource(codec_, in, std::move(prefix))]() { run(*source); });
+}
+
+ChunkReader::~ChunkReader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    space_.notify_all();
+    thread_.join();
+}
+
+void ChunkReader::run(ChunkSource& source) {
+    try {
+        bool last = false;
+        size_t wanted = firstChunkBytes_;
+        while (!last) {
+            PooledBuffer chunk = pool_.acquire(wanted);
+            chunk.resize(source.read(chunk.data(), wanted));
+            last = chunk.size() < wanted;
+            wanted = chunkBytes_;
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            space_.wait(lock, [&]() { return stop_ || chunks_.size() < kReadAhead; });
+            if (stop_) return;
+            chunks_.push_back(std::move(chunk));
+            done_ = last;
+            lock.unlock();
+            ready_.notify_one();
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = std::current_exception();
+        done_ = true;
+    }
+    ready_.notify_one();
+}
+
+PooledBuffer ChunkReader::next() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_.wait(lock, [&]() { return !chunks_.empty() || done_; });
+    if (chunks_.empty()) {
+        if (error_) std::rethrow_exception(error_);
+        return {};
+    }
+    PooledBuffer chunk = std::move(chunks_.front());
+    chunks_.pop_front();
+    lock.unlock();
+    space_.notify_one();
+    return chunk;
+}
+
+}  // namespace tracezl
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <istream>
+#include <mutex>
+#include <thread>
+
+#include "buffer_pool.h"
+
+namespace tracezl {
+
+// Compression a trace arrived in
+enum class InputCodec { None, Gzip, Xz };
+
+// Identify gzip or xz from the first bytes of a file; None otherwise
+InputCodec detectInputCodec(const void* data, size_t size);
+const char* inputCodecName(InputCodec codec);
+
+class ChunkSource;
+
+// Cuts a trace stream into chunks on a background thread, decoding gzip or
+// xz input on the way (detected from the stream itself), so reading and
+// decoding overlap with the compression of earlier chunks.
+class ChunkReader {
+public:
+    // `in` and `pool` must outlive the reader. The first chunk may have its
+    // own size, so later ones line up with a grid that started earlier.
+    ChunkReader(std::istream& in, size_t chunkBytes, BufferPool& pool, size_t firstChunkBytes = 0);
+    ~ChunkReader();
+
+    ChunkReader(const ChunkReader&) = delete;
+    ChunkReader& operator=(const ChunkReader&) = delete;
+
+    InputCodec codec() const { return codec_; }
+
+    // Chunks the reader holds besides those handed out: the read-ahead
+    // queue and the one being filled
+    static constexpr size_t kHeldChunks = 3;
+
+    // Next chunk of trace bytes. Only the last chunk is short (the first has
+    // its own size), and an empty buffer marks the end. Rethrows errors from the reader thread.
+    PooledBuffer next();
+
+private:
+    // Decoded chunks kept ready ahead of next()
+    static constexpr size_t kReadAhead = kHeldChunks - 1;
+
+    void run(ChunkSource& source);
+
+    InputCodec codec_ = InputCodec::None;
+    size_t chunkBytes_;
+    size_t firstChunkBytes_;
+    BufferPool& pool_;
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::condition_variable space_;
+    std::deque<PooledBuffer> chunks_;
+    bool done_ = false;
+    bool stop_ = false;
+    std::exception_ptr error_;
+    std::thread thread_;
+};
+
+}  // namespace tracezl
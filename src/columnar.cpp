@@ -0,0 +1,192 @@
+#include "columnar.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "little_endian.h"
+#include "openzl/zl_compress.h"
+#include "openzl/zl_decompress.h"
+#include "stats.h"
+#include "trace_codec.h"
+#include "trace_model.h"
+
+namespace tracezl {
+
+namespace {
+
+bool isColumnGroup(const void* data, size_t size) {
+    return size >= 4 && loadLE32((const char*)data) == kColumnMagic;
+}
+
+bool isStoredChunk(const void* data, size_t size) {
+    return size >= 4 && loadLE32((const char*)data) == kStoredMagic;
+}
+
+// Parsed column group directory
+struct ColumnDirectory {
+    uint8_t flags;
+    size_t numStreams;
+    uint64_t numInstrs;
+    uint64_t frameSizes[MAX_TAGS];
+    size_t size;  // directory bytes before the first frame
+
+    uint64_t totalSize() const {
+        uint64_t total = size;
+        for (size_t i = 0; i < numStreams; ++i) total += frameSizes[i];
+        return total;
+    }
+};
+
+// Parse the directory at the start of a column group, or nullopt if `size`
+// bytes do not hold all of it
+std::optional<ColumnDirectory> readDirectory(const void* data, size_t size) {
+    const char* p = (const char*)data;
+    if (size < kColumnHeaderSize) return std::nullopt;
+
+    ColumnDirectory dir;
+    dir.flags = (uint8_t)p[4];
+    dir.numStreams = (uint8_t)p[5];
+    dir.numInstrs = loadLE64(p + 8);
+    dir.size = kColumnHeaderSize + dir.numStreams * sizeof(uint64_t);
+    if (dir.numStreams > MAX_TAGS) throw std::runtime_error("Corrupt column group directory");
+    if (size < dir.size) return std::nullopt;
+    for (size_t i = 0; i < dir.numStreams; ++i) {
+        dir.frameSizes[i] = loadLE64(p + kColumnHeaderSize + i * sizeof(uint64_t));
+    }
+    return dir;
+}
+
+}  // namespace
+
+std::optional<ChunkSizes> probeChunk(const void* data, size_t size, TraceFormat format) {
+    if (isStoredChunk(data, size)) {
+        if (size < kStoredHeaderSize) return std::nullopt;
+        const uint32_t stored = loadLE32((const char*)data + 4);
+        return ChunkSizes{kStoredHeaderSize + stored, stored};
+    }
+    if (isColumnGroup(data, size)) {
+        const auto dir = readDirectory(data, size);
+        if (!dir) return std::nullopt;
+        return ChunkSizes{dir->totalSize(), dir->numInstrs * recordSize(format)};
+    }
+
+    ZL_Report sizeReport = ZL_getCompressedSize(data, size);
+    ZL_Report contentReport = ZL_getDecompressedSize(data, size);
+    if (ZL_isError(sizeReport) || ZL_isError(contentReport)) return std::nullopt;
+    return ChunkSizes{ZL_RES_value(sizeReport), ZL_RES_value(contentReport)};
+}
+
+PooledBuffer compressColumns(openzl::Compressor& streamCompressor, TraceFormat format,
+                             const void* src, size_t size, BufferPool& pool) {
+    const size_t numInstrs = size / recordSize(format);
+    if (numInstrs * recordSize(format) != size) {
+        throw std::runtime_error("Trace chunk is not a whole number of records");
+    }
+
+    StageTimer timer(threadStats());
+    FieldStream streams[MAX_TAGS];
+    const size_t numStreams = splitFields(format, src, size, pool, streams);
+    if (CompressStats* stats = threadStats()) {
+        for (size_t i = 0; i < numStreams; ++i) stats->fieldBytes[i] += streams[i].data.size();
+    }
+    timer.stop(STAGE_SPLIT);
+
+    const size_t dirSize = kColumnHeaderSize + numStreams * sizeof(uint64_t);
+    size_t bound = dirSize;
+    for (size_t i = 0; i < numStreams; ++i) bound += ZL_compressBound(streams[i].data.size());
+    PooledBuffer group = pool.acquire(bound);
+
+    char* const p = group.data();
+    storeLE32(p, kColumnMagic);
+    p[4] = (char)MODEL_ALL;
+    p[5] = (char)numStreams;
+    storeLE16(p + 6, 0);
+    storeLE64(p + 8, numInstrs);
+
+    size_t pos = dirSize;
+    for (size_t i = 0; i < numStreams; ++i) {
+        const FieldStream& stream = streams[i];
+        size_t frameSize = 0;
+        if (!stream.data.empty()) {
+            frameSize = compressStream(streamCompressor, p + pos, bound - pos, stream.data.data(),
+                                       stream.eltWidth, stream.data.size() / stream.eltWidth);
+        }
+        storeLE64(p + kColumnHeaderSize + i * sizeof(uint64_t), frameSize);
+        pos += frameSize;
+        if (CompressStats* stats = threadStats()) stats->fieldCompressed[i] += frameSize;
+    }
+    group.resize(pos);
+    return group;
+}
+
+PooledBuffer storeChunk(const void* src, size_t size, BufferPool& pool) {
+    PooledBuffer chunk = pool.acquire(kStoredHeaderSize + size);
+    storeLE32(chunk.data(), kStoredMagic);
+    storeLE32(chunk.data() + 4, (uint32_t)size);
+    std::memcpy(chunk.data() + kStoredHeaderSize, src, size);
+    return chunk;
+}
+
+std::optional<ColumnStreams> decodeColumns(TraceFormat format, FieldMask fields, const void* src,
+                                           size_t size, BufferPool& pool) {
+    if (!isColumnGroup(src, size)) return std::nullopt;
+    const auto dir = readDirectory(src, size);
+    if (!dir || dir->totalSize() != size || dir->numStreams != fieldSplitStreams(format)) {
+        throw std::runtime_error("Corrupt column group directory");
+    }
+
+    ColumnStreams columns = {.numInstrs = dir->numInstrs, .modelFlags = dir->flags};
+    const uint32_t needed = streamsForFields(fields);
+    const char* frame = (const char*)src + dir->size;
+    for (size_t i = 0; i < dir->numStreams; ++i) {
+        if ((needed & fieldBit(i)) && dir->frameSizes[i] > 0) {
+            size_t eltWidth;
+            columns.data[i] = decompressStream(frame, dir->frameSizes[i], pool, &eltWidth);
+            columns.views[i] = {.data = columns.data[i].data(),
+                                .numElts = columns.data[i].size() / eltWidth,
+                                .eltWidth = eltWidth};
+        }
+        frame += dir->frameSizes[i];
+    }
+    return columns;
+}
+
+size_t decodeChunk(TraceFormat format, FieldMask fields, const void* src, size_t size,
+                   void* dst, size_t capacity, BufferPool& pool) {
+    if (isStoredChunk(src, size)) {
+        // Less than a record, so there are no fields to mask
+        const size_t stored = size - kStoredHeaderSize;
+        if (size < kStoredHeaderSize || loadLE32((const char*)src + 4) != stored ||
+            stored > capacity) {
+            throw std::runtime_error("Corrupt stored chunk");
+        }
+        std::memcpy(dst, (const char*)src + kStoredHeaderSize, stored);
+        return stored;
+    }
+    if (!isColumnGroup(src, size)) {
+        const size_t dSize = decompressChunk(dst, capacity, src, size);
+        if ((fields & kAllFields) != kAllFields) {
+            maskFields(format, dst, dSize / recordSize(format), fields);
+        }
+        return dSize;
+    }
+
+    // Decode only the streams the fields are rebuilt from
+    const ColumnStreams columns = *decodeColumns(format, fields, src, size, pool);
+    const size_t outSize = columns.numInstrs * recordSize(format);
+    if (outSize > capacity) throw std::runtime_error("Column group larger than its chunk");
+    mergeFields(format, columns.views, columns.numInstrs, columns.modelFlags, fields, dst);
+    return outSize;
+}
+
+PooledBuffer decodeChunk(TraceFormat format, FieldMask fields, const void* src, size_t size,
+                         BufferPool& pool) {
+    const auto sizes = probeChunk(src, size, format);
+    if (!sizes) throw std::runtime_error("Corrupt frame header");
+    PooledBuffer decoded = pool.acquire(sizes->decompressed);
+    decoded.resize(decodeChunk(format, fields, src, size, decoded.data(), decoded.size(), pool));
+    return decoded;
+}
+
+}  // namespace tracezl
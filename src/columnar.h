@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include "buffer_pool.h"
+#include "common.h"
+#include "openzl/cpp/Compressor.hpp"
+#include "trace_codec.h"
+#include "trace_format.h"
+
+namespace tracezl {
+
+// A chunk is stored either as one OpenZL frame of the trained graph (a row
+// chunk) or, in archives written with --columnar, as a column group: one
+// frame per field stream, so a reader decodes only the streams of the fields
+// it needs.
+//
+//   [u32 kColumnMagic][u8 model flags][u8 stream count][u16 reserved]
+//   [u64 instruction count][u64 frame size per stream][frames...]
+//
+// Streams are in FieldTag order and hold what the field splitter emits. An
+// empty stream has size zero and no frame.
+//
+// A trailing partial record cannot go through the field splitter, so it is
+// kept verbatim in a stored chunk of its own: [u32 kStoredMagic][u32 size]
+// [bytes]. All kinds of chunk can be told apart from their first bytes.
+constexpr uint32_t kColumnMagic = 0x434C5A54;  // "TZLC"
+constexpr size_t kColumnHeaderSize = 16;
+constexpr uint32_t kStoredMagic = 0x534C5A54;  // "TZLS"
+constexpr size_t kStoredHeaderSize = 8;
+
+// Compressed and decompressed size of one stored chunk
+struct ChunkSizes {
+    uint64_t compressed;
+    uint64_t decompressed;
+};
+
+// Sizes of the row frame or column group of `format` records at the start of
+// `data`, or nullopt if `size` bytes are not enough to tell
+std::optional<ChunkSizes> probeChunk(const void* data, size_t size, TraceFormat format);
+
+// Store whole records of `format` as a column group. `streamCompressor` comes
+// from createStreamCompressor().
+PooledBuffer compressColumns(openzl::Compressor& streamCompressor, TraceFormat format,
+                             const void* src, size_t size, BufferPool& pool);
+
+// Keep `size` bytes, less than a record, as a stored chunk
+PooledBuffer storeChunk(const void* src, size_t size, BufferPool& pool);
+
+// Decoded field streams of a column group
+struct ColumnStreams {
+    uint64_t numInstrs;
+    uint8_t modelFlags;
+    PooledBuffer data[MAX_TAGS];
+    StreamView views[MAX_TAGS];  // over `data`; empty where not decoded
+};
+
+// Decode the streams of a column group that the `fields` of its records are
+// rebuilt from, as streamsForFields() names them, without rebuilding the
+// records. Returns nullopt for a row or stored chunk.
+std::optional<ColumnStreams> decodeColumns(TraceFormat format, FieldMask fields, const void* src,
+                                           size_t size, BufferPool& pool);
+
+// Decode a stored chunk into `dst`, keeping `fields` and zeroing the others.
+// Column groups decode only the streams those fields need; row chunks are
+// decoded whole. Returns the decoded size.
+size_t decodeChunk(TraceFormat format, FieldMask fields, const void* src, size_t size,
+                   void* dst, size_t capacity, BufferPool& pool);
+// Same, into a buffer from `pool`
+PooledBuffer decodeChunk(TraceFormat format, FieldMask fields, const void* src, size_t size,
+                         BufferPool& pool);
+
+}  // namespace tracezl
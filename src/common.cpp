@@ -1,118 +1,58 @@
 #include "common.h"
 
 #include <cassert>
+#include <fstream>
+#include <new>
+#include <stdexcept>
 #include <vector>
 
-#include "champsim_trace.h"
 #include "openzl/codecs/zl_ace.h"
+#include "openzl/cpp/CCtx.hpp"
+#include "openzl/cpp/DCtx.hpp"
+#include "openzl/zl_compress.h"
+#include "openzl/zl_decompress.h"
 #include "openzl/zl_errors.h"
+#include "openzl/zl_public_nodes.h"
+#include "trace_codec.h"
 
 namespace tracezl {
 
-// Dispatch function to split ChampSim trace struct into fields
+// Graph function to split fixed-size trace records into fields
 ZL_Report traceDispatchFn(ZL_Graph* graph, ZL_Edge* inputEdges[], size_t numInputs) noexcept {
     ZL_RESULT_DECLARE_SCOPE_REPORT(graph);
 
     assert(numInputs == 1);
-    const ZL_Input* const input = ZL_Edge_getData(inputEdges[0]);
-    // const uint8_t* const inputData = (const uint8_t*)ZL_Input_ptr(input);
-    const size_t inputSize = ZL_Input_numElts(input);
-
-    // ChampSim trace instruction size is 64 bytes
-    const size_t instrSize = sizeof(trace_instr_format_t);
-
-    // if (inputSize % instrSize != 0) { ... }
-
-    size_t numInstrs = inputSize / instrSize;
-
-    // We need to construct the dispatch arrays
-    // For each instruction, we emit segments for each field
-    std::vector<unsigned> tags;
-    std::vector<size_t> sizes;
-    tags.reserve(numInstrs * NUM_TAGS);
-    sizes.reserve(numInstrs * NUM_TAGS);
-
-    for (size_t i = 0; i < numInstrs; ++i) {
-        // IP: 8 bytes
-        tags.push_back(TAG_IP);
-        sizes.push_back(8);
-        // is_branch: 1 byte
-        tags.push_back(TAG_IS_BRANCH);
-        sizes.push_back(1);
-        // branch_taken: 1 byte
-        tags.push_back(TAG_BRANCH_TAKEN);
-        sizes.push_back(1);
-        // dest_regs: 2 bytes
-        tags.push_back(TAG_DEST_REGS);
-        sizes.push_back(2);
-        // source_regs: 4 bytes
-        tags.push_back(TAG_SOURCE_REGS);
-        sizes.push_back(4);
-        // dest_mem: 16 bytes
-        tags.push_back(TAG_DEST_MEM);
-        sizes.push_back(16);
-        // source_mem: 32 bytes
-        tags.push_back(TAG_SOURCE_MEM);
-        sizes.push_back(32);
-    }
-
-    ZL_DispatchInstructions instructions = {.segmentSizes = sizes.data(),
-                                            .tags = tags.data(),
-                                            .nbSegments = sizes.size(),
-                                            .nbTags = NUM_TAGS};
-
-    ZL_TRY_LET(ZL_EdgeList, dispatchEdges, ZL_Edge_runDispatchNode(inputEdges[0], &instructions));
-
-    // Expect NUM_TAGS + 2 output edges
-    // Edge 0: Tags stream
-    // Edge 1: Sizes stream
-    // Edge 2..8: Data streams for tags 0..6
-
-    // Route tags and sizes to generic compressor
-    ZL_ERR_IF_ERR(ZL_Edge_setDestination(dispatchEdges.edges[0], ZL_GRAPH_COMPRESS_GENERIC));
-    ZL_ERR_IF_ERR(ZL_Edge_setDestination(dispatchEdges.edges[1], ZL_GRAPH_COMPRESS_GENERIC));
-
-    // Prepare data edges for clustering
-    std::vector<ZL_Edge*> outputEdges;
-    outputEdges.reserve(NUM_TAGS);
-
-    // Define element widths for interpretation (in bytes)
-    const size_t eltWidths[NUM_TAGS] = {8, 1, 1, 1, 1, 8, 8};
-
-    for (int i = 0; i < NUM_TAGS; ++i) {
-        ZL_Edge* dataEdge = dispatchEdges.edges[2 + i];
-
-        // Interpret as LE numeric stream
-        ZL_NodeID node = ZL_Node_interpretAsLE(eltWidths[i] * 8);
-        ZL_TRY_LET(ZL_EdgeList, convertEdges, ZL_Edge_runNode(dataEdge, node));
-        assert(convertEdges.nbEdges == 1);
 
-        ZL_Edge* convertedEdge = convertEdges.edges[0];
+    // The field splitter walks the records at the format's fixed stride and
+    // emits one typed numeric stream per field plus the slot occupancy
+    // bitmap, so no per-record dispatch metadata is produced or stored.
+    ZL_NodeIDList customNodes = ZL_Graph_getCustomNodes(graph);
+    ZL_ERR_IF_NE(customNodes.nbNodeIDs, 1, graphParameter_invalid);
 
-        outputEdges.push_back(convertedEdge);
-    }
+    ZL_TRY_LET(ZL_EdgeList, fieldEdges, ZL_Edge_runNode(inputEdges[0], customNodes.nodeids[0]));
 
-    // Get custom graphs (ACE graphs for each field)
+    // Get custom graphs (ACE graphs for each stream)
     ZL_GraphIDList customGraphs = ZL_Graph_getCustomGraphs(graph);
-    ZL_ERR_IF_NE(customGraphs.nbGraphIDs, NUM_TAGS, graphParameter_invalid);
+    ZL_ERR_IF_NE(customGraphs.nbGraphIDs, fieldEdges.nbEdges, graphParameter_invalid);
 
-    // Send each field to its dedicated ACE graph
-    for (int i = 0; i < NUM_TAGS; ++i) {
-        ZL_ERR_IF_ERR(ZL_Edge_setDestination(outputEdges[i], customGraphs.graphids[i]));
+    // Send each stream to its dedicated ACE graph
+    for (size_t i = 0; i < fieldEdges.nbEdges; ++i) {
+        ZL_ERR_IF_ERR(ZL_Edge_setDestination(fieldEdges.edges[i], customGraphs.graphids[i]));
     }
 
     return ZL_returnSuccess();
 }
 
-ZL_GraphID registerGraph(openzl::Compressor& compressor) {
-    // Create an ACE graph for each field type
+ZL_GraphID registerGraph(openzl::Compressor& compressor, TraceFormat format) {
+    // Create an ACE graph for each stream
     std::vector<ZL_GraphID> aceGraphs;
-    for (int i = 0; i < NUM_TAGS; ++i) {
+    for (size_t i = 0; i < fieldSplitStreams(format); ++i) {
         aceGraphs.push_back(ZL_Compressor_buildACEGraph(compressor.get()));
     }
 
-    // Register our Parsing/Dispatch Graph
-    auto parsingGraphName = "ChampSimTraceParser";
+    // Register our Parsing/Dispatch Graph, one per format
+    auto parsingGraphName =
+        format == TraceFormat::ChampSim ? "ChampSimTraceParser" : "CloudSuiteTraceParser";
     auto parsingGraph = compressor.getGraph(parsingGraphName);
 
     if (!parsingGraph) {
@@ -127,17 +67,116 @@ ZL_GraphID registerGraph(openzl::Compressor& compressor) {
         parsingGraph = compressor.registerFunctionGraph(desc);
     }
 
-    // Parameterize the parsing graph with the ACE graphs as custom targets
-    openzl::GraphParameters params = {.customGraphs = std::move(aceGraphs)};
+    // Parameterize the parsing graph with the field splitter and the ACE
+    // graphs as custom targets
+    ZL_NodeID splitNode = registerFieldSplitEncoder(compressor, format);
+    openzl::GraphParameters params = {.customGraphs = std::move(aceGraphs),
+                                      .customNodes = std::vector<ZL_NodeID>{splitNode}};
 
     return compressor.parameterizeGraph(parsingGraph.value(), params);
 }
 
-std::unique_ptr<openzl::Compressor> createCompressorFromSerialized(openzl::poly::string_view serialized) {
+std::string loadConfig(const std::string& config_path) {
+    std::ifstream configFile(config_path, std::ios::binary | std::ios::ate);
+    if (!configFile) throw std::runtime_error("Cannot open config file");
+    size_t configSize = configFile.tellg();
+    configFile.seekg(0);
+    std::string configData(configSize, '\0');
+    configFile.read(&configData[0], configSize);
+    return configData;
+}
+
+std::unique_ptr<openzl::Compressor> createCompressorFromSerialized(
+    openzl::poly::string_view serialized, TraceFormat format) {
     auto compressor = std::make_unique<openzl::Compressor>();
-    registerGraph(*compressor);
+    registerGraph(*compressor, format);
     compressor->deserialize(serialized);
     return compressor;
 }
 
+namespace {
+
+openzl::CCtx& threadCCtx() {
+    thread_local std::unique_ptr<openzl::CCtx> cctx;
+    if (!cctx) cctx = std::make_unique<openzl::CCtx>();
+    return *cctx;
+}
+
+openzl::DCtx& threadDCtx() {
+    thread_local std::unique_ptr<openzl::DCtx> dctx;
+    if (!dctx) {
+        dctx = std::make_unique<openzl::DCtx>();
+        registerDecoders(*dctx);
+    }
+    return *dctx;
+}
+
+}  // namespace
+
+PooledBuffer compressChunk(openzl::Compressor& compressor, const void* src, size_t size,
+                           BufferPool& pool) {
+    openzl::CCtx& cctx = threadCCtx();
+    cctx.refCompressor(compressor);
+    cctx.setParameter(openzl::CParam::FormatVersion, ZL_MAX_FORMAT_VERSION);
+    cctx.setParameter(openzl::CParam::StickyParameters, 1);  // Sticky local to this CCtx, fine.
+
+    PooledBuffer compressed = pool.acquire(ZL_compressBound(size));
+    ZL_Report res =
+        ZL_CCtx_compress(cctx.get(), compressed.data(), compressed.size(), src, size);
+    compressed.resize(cctx.unwrap(res, "Compression failed"));
+    return compressed;
+}
+
+size_t decompressChunk(void* dst, size_t capacity, const void* src, size_t size) {
+    openzl::DCtx& dctx = threadDCtx();
+    ZL_Report res = ZL_DCtx_decompress(dctx.get(), dst, capacity, src, size);
+    return dctx.unwrap(res, "Decompression failed");
+}
+
+PooledBuffer decompressFrame(const void* src, size_t size, BufferPool& pool) {
+    ZL_Report sizeReport = ZL_getDecompressedSize(src, size);
+    if (ZL_isError(sizeReport)) throw std::runtime_error("Corrupt frame header");
+    PooledBuffer decompressed = pool.acquire(ZL_RES_value(sizeReport));
+    decompressed.resize(
+        decompressChunk(decompressed.data(), decompressed.size(), src, size));
+    return decompressed;
+}
+
+std::unique_ptr<openzl::Compressor> createStreamCompressor() {
+    auto compressor = std::make_unique<openzl::Compressor>();
+    compressor->setParameter(openzl::CParam::FormatVersion, ZL_MAX_FORMAT_VERSION);
+    openzl::unwrap(
+        ZL_Compressor_selectStartingGraphID(compressor->get(), ZL_GRAPH_COMPRESS_GENERIC),
+        "Failed to select starting graph");
+    return compressor;
+}
+
+size_t compressStream(openzl::Compressor& compressor, void* dst, size_t capacity,
+                      const void* src, size_t eltWidth, size_t numElts) {
+    openzl::CCtx& cctx = threadCCtx();
+    cctx.refCompressor(compressor);
+    ZL_TypedRef* input = ZL_TypedRef_createNumeric(src, eltWidth, numElts);
+    if (!input) throw std::bad_alloc();
+    ZL_Report res = ZL_CCtx_compressTypedRef(cctx.get(), dst, capacity, input);
+    ZL_TypedRef_free(input);
+    return cctx.unwrap(res, "Stream compression failed");
+}
+
+PooledBuffer decompressStream(const void* src, size_t size, BufferPool& pool, size_t* eltWidth) {
+    ZL_Report sizeReport = ZL_getDecompressedSize(src, size);
+    if (ZL_isError(sizeReport)) throw std::runtime_error("Corrupt stream frame header");
+    PooledBuffer decompressed = pool.acquire(ZL_RES_value(sizeReport));
+
+    openzl::DCtx& dctx = threadDCtx();
+    ZL_OutputInfo info;
+    ZL_Report res = ZL_DCtx_decompressTyped(dctx.get(), &info, decompressed.data(),
+                                            decompressed.size(), src, size);
+    decompressed.resize(dctx.unwrap(res, "Stream decompression failed"));
+    if (info.type != ZL_Type_numeric || info.fixedWidth == 0) {
+        throw std::runtime_error("Stream frame is not numeric");
+    }
+    *eltWidth = info.fixedWidth;
+    return decompressed;
+}
+
 }  // namespace tracezl
@@ -1,28 +1,47 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
+#include "buffer_pool.h"
 #include "openzl/cpp/Compressor.hpp"
 #include "openzl/zl_graph_api.h"
+#include "trace_format.h"
 
 namespace tracezl {
 
-// Define tags for our fields
-enum FieldTag {
-    TAG_IP = 0,
-    TAG_IS_BRANCH,
-    TAG_BRANCH_TAKEN,
-    TAG_DEST_REGS,
-    TAG_SOURCE_REGS,
-    TAG_DEST_MEM,
-    TAG_SOURCE_MEM,
-    NUM_TAGS
-};
-
 // Common helper functions
 ZL_Report traceDispatchFn(ZL_Graph* graph, ZL_Edge* inputEdges[], size_t numInputs) noexcept;
-ZL_GraphID registerGraph(openzl::Compressor& compressor);
+// Register the parsing graph of `format` and return it
+ZL_GraphID registerGraph(openzl::Compressor& compressor,
+                         TraceFormat format = TraceFormat::ChampSim);
+// Read a serialized config file
+std::string loadConfig(const std::string& config_path);
+// Load a config trained on traces of `format`
 std::unique_ptr<openzl::Compressor> createCompressorFromSerialized(
-    openzl::poly::string_view serialized);
+    openzl::poly::string_view serialized, TraceFormat format = TraceFormat::ChampSim);
+
+// Chunk codecs. Each thread keeps one long-lived CCtx and one DCtx with the
+// tracezl decoders registered, so no context is built per chunk.
+
+// Compress one chunk of records into a standalone frame held in a buffer
+// from `pool`
+PooledBuffer compressChunk(openzl::Compressor& compressor, const void* src, size_t size,
+                           BufferPool& pool);
+// Decode one frame into `dst`, returning the decompressed size
+size_t decompressChunk(void* dst, size_t capacity, const void* src, size_t size);
+// Decode one frame into a buffer from `pool`
+PooledBuffer decompressFrame(const void* src, size_t size, BufferPool& pool);
+
+// Compressor that sends a single numeric stream through the generic graph,
+// for column frames and per-field cost attribution
+std::unique_ptr<openzl::Compressor> createStreamCompressor();
+// Compress `numElts` numeric elements of `eltWidth` bytes into `dst`,
+// returning the frame size
+size_t compressStream(openzl::Compressor& compressor, void* dst, size_t capacity,
+                      const void* src, size_t eltWidth, size_t numElts);
+// Decode a frame of one numeric stream into a buffer from `pool`; `eltWidth`
+// receives its element width
+PooledBuffer decompressStream(const void* src, size_t size, BufferPool& pool, size_t* eltWidth);
 
 }  // namespace tracezl
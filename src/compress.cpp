@@ -1,109 +1,671 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <deque>
+#include <filesystem>
 #include <fstream>
 #include <future>
 #include <iostream>
+#include <memory>
+#include <set>
 #include <stdexcept>
 #include <vector>
 
+#include "buffer_pool.h"
+#include "checksum.h"
+#include "chunk_reader.h"
+#include "columnar.h"
 #include "common.h"
 #include "compressor.h"
-#include "openzl/cpp/CCtx.hpp"
+#include "container.h"
+#include "io.h"
+#include "levels.h"
 #include "openzl/zl_compress.h"
+#include "stats.h"
 #include "tools/training/utils/thread_pool.h"
 
 // Removed using namespace
 
-void compress_trace(const std::string& trace_path, const std::string& output_path,
-                    const std::string& config_path, size_t chunk_size, size_t num_threads) {
-    std::cout << "Compressing " << trace_path << " with " << num_threads << " threads..."
-              << std::endl;
-
-    // Load config
-    std::ifstream configFile(config_path, std::ios::binary | std::ios::ate);
-    if (!configFile) throw std::runtime_error("Cannot open config file");
-    size_t configSize = configFile.tellg();
-    configFile.seekg(0);
-    std::string configData(configSize, '\0');
-    configFile.read(&configData[0], configSize);
+namespace {
 
+// State shared by every archive of a run. Built once, read-only afterwards.
+struct CompressContext {
+    const CompressOptions& options;
+    std::string configData;
     // Setup compressor (shared across threads)
-    auto compressor = tracezl::createCompressorFromSerialized(configData);
-    compressor->setParameter(openzl::CParam::FormatVersion, ZL_MAX_FORMAT_VERSION);
+    std::unique_ptr<openzl::Compressor> compressor;
+    // Compresses field streams on their own, for --columnar
+    std::unique_ptr<openzl::Compressor> fieldCompressor;
+    // Chunks hold whole records; a trailing partial record is stored apart
+    size_t chunkBytes;
+    // Chunks read but not yet written out; submission waits on the oldest
+    // chunk when this many are in flight
+    size_t queueDepth;
+    // Merged stats of every written chunk, or null without --stats
+    tracezl::CompressStats* stats;
+    // Input and frame buffers, recycled across chunks
+    tracezl::BufferPool* buffers;
+};
 
-    // Open Input File
-    std::ifstream inFile(trace_path, std::ios::binary | std::ios::ate);
-    if (!inFile) throw std::runtime_error("Cannot open trace file");
-    size_t totalSize = inFile.tellg();
-    inFile.seekg(0);
+// A compressed chunk and the checksum of its input
+struct CompressedChunk {
+    tracezl::PooledBuffer frame;
+    uint64_t checksum;
+};
 
-    // Open Output File
-    std::ofstream outFile(output_path, std::ios::binary);
-    if (!outFile) throw std::runtime_error("Cannot open output file");
+// One trace being compressed into one archive. Chunks are submitted to the
+// pool in order and written back in the same order.
+class CompressJob {
+public:
+    CompressJob(const std::string& trace_path, const std::string& output_path,
+                const CompressContext& ctx);
+    // An append that did not finish puts the archive back as it was
+    ~CompressJob();
 
-    // Thread Pool
-    openzl::training::ThreadPool pool(num_threads);
-    std::deque<std::future<std::string>> futures;
-    const size_t max_queue_size = num_threads * 2;
+    // Read the next chunk and hand it to the pool. Returns the number of
+    // chunks queued, which is 2 when a trailing partial record is stored
+    // apart, and 0 at the end of input.
+    size_t submitNext(openzl::training::ThreadPool& pool);
+    bool hasPending() const { return !futures_.empty(); }
+    // Write the oldest chunk and record where it landed
+    void writeFront();
+    // Drain, then append the index and patch the header
+    void finish();
 
-    size_t processed = 0;
-    size_t totalCompressed = 0;
+    // Compression of the input trace, decoded on the fly
+    tracezl::InputCodec inputCodec() const {
+        return reader_ ? reader_->codec() : tracezl::InputCodec::None;
+    }
+    // Input bytes submitted so far, and the input size when it is known
+    size_t processed() const { return processed_; }
+    std::optional<size_t> totalSize() const { return totalSize_; }
+    size_t totalCompressed() const { return totalCompressed_; }
 
-    while (processed < totalSize) {
-        // Flow control: if queue is full, write one result
-        if (futures.size() >= max_queue_size) {
-            std::string result = futures.front().get();
-            futures.pop_front();
+private:
+    struct PendingChunk {
+        std::future<CompressedChunk> result;
+        size_t size;
+        std::unique_ptr<tracezl::CompressStats> stats;
+    };
 
-            outFile.write(result.data(), result.size());
-            totalCompressed += result.size();
+    const CompressContext& ctx_;
+    std::unique_ptr<tracezl::MappedFile> mapped_;
+    std::unique_ptr<tracezl::InputFile> input_;
+    std::unique_ptr<tracezl::ChunkReader> reader_;
+    std::optional<size_t> totalSize_;
+    // Hand one chunk to the pool; `stored` keeps it verbatim
+    void submitChunk(openzl::training::ThreadPool& pool, tracezl::PooledBuffer owned,
+                     const char* chunkData, size_t size, bool stored);
+    // Write a new archive header
+    void createArchive(const std::string& output_path);
+    // Check an existing archive and load what appending to it needs; the
+    // archive is left untouched
+    void readForAppend(const std::string& output_path);
+    // Open the archive checked by readForAppend() to write after its kept chunks
+    void openForAppend();
+    // Undo an unfinished append
+    void restoreArchive() noexcept;
+
+    std::unique_ptr<tracezl::OutputFile> output_;
+    // Archive offset of the first chunk this job writes
+    size_t framesStart_ = 0;
+    tracezl::ChunkIndex index_;
+    // Decoded last chunk of an appended archive that ends in a partial
+    // record; it goes ahead of the new input
+    tracezl::PooledBuffer carry_;
+    // Input bytes of the first chunk, which completes the carried chunk
+    size_t firstChunkBytes_;
+    // Appended archive, and what new chunks write over: its size and header
+    // instruction count, and its bytes from framesStart_ on (the re-encoded
+    // last chunk, the old index and the trailer). They are put back unless
+    // finish() completes.
+    std::string appendPath_;
+    size_t archiveSize_ = 0;
+    uint64_t archiveInstrs_ = 0;
+    std::string displaced_;
+    bool finished_ = false;
+    std::deque<PendingChunk> futures_;
+    bool eof_ = false;
+    size_t processed_ = 0;
+    size_t totalCompressed_ = 0;
+};
+
+CompressJob::CompressJob(const std::string& trace_path, const std::string& output_path,
+                         const CompressContext& ctx)
+    : ctx_(ctx), index_(ctx.options.format) {
+    if (ctx.options.append) readForAppend(output_path);
+
+    // Cut the first chunk so it ends on a record boundary of the whole trace,
+    // after which chunks fall on the usual grid. The carried partial record
+    // is shorter than a record, so it always fits in a chunk.
+    firstChunkBytes_ = ctx.chunkBytes - carry_.size();
+
+    // Open Input File. Regular files are memory mapped and workers compress
+    // straight out of the mapping; pipes and gzip or xz traces are read chunk
+    // by chunk on a reader thread until EOF, so their size is not known up
+    // front.
+    if (ctx.options.use_mmap && tracezl::isRegularFile(trace_path)) {
+        mapped_ = std::make_unique<tracezl::MappedFile>(trace_path);
+        totalSize_ = mapped_->size();
+        if (tracezl::detectInputCodec(mapped_->data(), mapped_->size()) !=
+            tracezl::InputCodec::None) {
+            mapped_.reset();
         }
+    }
+    if (!mapped_) {
+        input_ = std::make_unique<tracezl::InputFile>(trace_path);
+        reader_ = std::make_unique<tracezl::ChunkReader>(input_->stream(), ctx.chunkBytes,
+                                                         *ctx.buffers, firstChunkBytes_);
+        totalSize_ = inputCodec() == tracezl::InputCodec::None ? input_->size() : std::nullopt;
+    }
+
+    // The output is only touched once the input has opened
+    if (ctx.options.append) {
+        openForAppend();
+    } else {
+        createArchive(output_path);
+    }
+}
+
+CompressJob::~CompressJob() {
+    if (!appendPath_.empty() && !finished_) restoreArchive();
+}
+
+void CompressJob::createArchive(const std::string& output_path) {
+    // Open Output File. The header records what decompression needs to know
+    // up front; the instruction count is patched in once known, unless the
+    // output is a pipe.
+    output_ = std::make_unique<tracezl::OutputFile>(output_path);
+    tracezl::ArchiveHeader header = {
+        .format = ctx_.options.format,
+        .configHash = tracezl::xxh64(ctx_.configData.data(), ctx_.configData.size())};
+    if (ctx_.options.embed_config) {
+        header.flags |= tracezl::ARCHIVE_EMBEDDED_CONFIG;
+        header.config = ctx_.configData;
+    }
+    if (ctx_.options.columnar) header.flags |= tracezl::ARCHIVE_COLUMNAR;
+    tracezl::writeArchiveHeader(output_->stream(), header);
+    framesStart_ = header.size();
+}
 
-        size_t remaining = totalSize - processed;
-        size_t toRead = std::min(remaining, chunk_size);
+void CompressJob::readForAppend(const std::string& output_path) {
+    if (!tracezl::isRegularFile(output_path)) {
+        throw std::runtime_error("--append needs an existing archive file");
+    }
+    std::ifstream archive(output_path, std::ios::binary | std::ios::ate);
+    if (!archive) throw std::runtime_error("Cannot open archive " + output_path);
+    const size_t archiveSize = archive.tellg();
+
+    // New chunks must decode like the old ones and come from the same config
+    const tracezl::ArchiveHeader header = tracezl::readArchiveHeader(archive, archiveSize);
+    if (header.format != ctx_.options.format) {
+        throw std::runtime_error(output_path + " holds " + tracezl::formatName(header.format) +
+                                 " records, not " + tracezl::formatName(ctx_.options.format));
+    }
+    if (header.configHash != tracezl::xxh64(ctx_.configData.data(), ctx_.configData.size())) {
+        throw std::runtime_error(output_path +
+                                 " was compressed with a different config or level");
+    }
+    if (bool(header.flags & tracezl::ARCHIVE_COLUMNAR) != ctx_.options.columnar) {
+        throw std::runtime_error(ctx_.options.columnar
+                                     ? output_path + " is not columnar; drop --columnar"
+                                     : output_path + " is columnar; pass --columnar");
+    }
+
+    // Kept chunks carry their checksums over, so a scanned index will not do
+    auto index = tracezl::readChunkIndex(archive, archiveSize);
+    if (!index) {
+        throw std::runtime_error(output_path +
+                                 " has no chunk index; its trailer is missing or damaged");
+    }
 
-        // Align to 64 bytes
-        if (toRead % 64 != 0 && toRead < remaining) {
-            toRead = (toRead / 64) * 64;
+    // A partial record at the end of the trace is the stored chunk that
+    // closes the archive, and the new input completes it: its bytes are
+    // taken back and lead the first new chunk
+    size_t keep = index->size();
+    const size_t recordSize = tracezl::recordSize(ctx_.options.format);
+    if (keep > 0 && (*index)[keep - 1].uncompressedSize % recordSize != 0) {
+        const tracezl::ChunkIndexEntry& last = (*index)[keep - 1];
+        tracezl::PooledBuffer frame = ctx_.buffers->acquire(last.compressedSize);
+        archive.clear();
+        archive.seekg(last.compressedOffset);
+        archive.read(frame.data(), frame.size());
+        if ((size_t)archive.gcount() != frame.size()) {
+            throw std::runtime_error("Unexpected EOF reading the last chunk of " + output_path);
         }
+        carry_ = tracezl::decodeChunk(ctx_.options.format, tracezl::kAllFields, frame.data(),
+                                      frame.size(), *ctx_.buffers);
+        if (carry_.size() != last.uncompressedSize || carry_.size() >= recordSize ||
+            !index->checksumMatches(keep - 1, carry_.data(), carry_.size())) {
+            throw std::runtime_error("The last chunk of " + output_path +
+                                     " fails verification; not appending");
+        }
+        --keep;
+    }
 
-        // Read chunk
-        std::vector<char> buffer(toRead);
-        inFile.read(buffer.data(), toRead);
-        processed += toRead;
+    index_ = tracezl::ChunkIndex(ctx_.options.format);
+    for (size_t i = 0; i < keep; ++i) index_.add((*index)[i]);
+    framesStart_ = keep > 0 ? index_.framesEnd() : header.size();
+
+    displaced_.resize(archiveSize - framesStart_);
+    archive.clear();
+    archive.seekg(framesStart_);
+    archive.read(displaced_.data(), displaced_.size());
+    if ((size_t)archive.gcount() != displaced_.size()) {
+        throw std::runtime_error("Unexpected EOF reading the index of " + output_path);
+    }
+    appendPath_ = output_path;
+    archiveSize_ = archiveSize;
+    archiveInstrs_ = header.numInstrs;
+}
+
+void CompressJob::openForAppend() {
+    // New chunks go right after the kept ones. The old index and trailer are
+    // written over rather than cut off, and the file is only trimmed once the
+    // new index is in place.
+    output_ = std::make_unique<tracezl::OutputFile>(appendPath_, true);
+    output_->stream().seekp(framesStart_);
+    if (!output_->stream()) throw std::runtime_error("Cannot seek in archive " + appendPath_);
+}
 
-        // Submit task
-        // We capture compressor by raw pointer. The main thread outlives the tasks.
-        openzl::Compressor* rawCompressor = compressor.get();
+void CompressJob::restoreArchive() noexcept {
+    try {
+        output_.reset();
+        std::fstream archive(appendPath_, std::ios::binary | std::ios::in | std::ios::out);
+        archive.seekp(framesStart_);
+        archive.write(displaced_.data(), displaced_.size());
+        tracezl::patchArchiveInstrs(archive, archiveInstrs_);
+        archive.close();
+        std::error_code ec;
+        std::filesystem::resize_file(appendPath_, archiveSize_, ec);
+        if (archive && !ec) return;
+    } catch (const std::exception&) {
+    }
+    std::cerr << "Warning: could not restore " << appendPath_ << " after the failed append"
+              << std::endl;
+}
 
-        futures.push_back(pool.run([rawCompressor, data = std::move(buffer)]() -> std::string {
-            openzl::CCtx cctx;
-            cctx.refCompressor(*rawCompressor);
-            cctx.setParameter(openzl::CParam::FormatVersion, ZL_MAX_FORMAT_VERSION);
-            cctx.setParameter(openzl::CParam::StickyParameters,
-                              1);  // Sticky local to this CCtx, fine.
+size_t CompressJob::submitNext(openzl::training::ThreadPool& pool) {
+    if (eof_) return 0;
 
-            size_t bound = ZL_compressBound(data.size());
-            std::string compressed(bound, '\0');
+    // Next chunk: a view into the mapping, or a buffer from the reader
+    // thread. A short chunk means the input is exhausted.
+    tracezl::StageTimer readTimer(ctx_.stats);
+    const size_t wanted = processed_ == 0 ? firstChunkBytes_ : ctx_.chunkBytes;
+    size_t toRead = wanted;
+    if (totalSize_) toRead = std::min(toRead, *totalSize_ - processed_);
+    tracezl::PooledBuffer buffer;
+    const char* chunkData;
+    if (mapped_) {
+        chunkData = mapped_->data() + processed_;
+        mapped_->prefetch(processed_, toRead);
+    } else {
+        buffer = reader_->next();
+        toRead = buffer.size();
+        chunkData = buffer.data();
+    }
+    if (toRead < wanted) eof_ = true;
+    if (toRead == 0 && carry_.empty()) return 0;
+    processed_ += toRead;
 
-            ZL_Report res =
-                ZL_CCtx_compress(cctx.get(), compressed.data(), bound, data.data(), data.size());
-            size_t cSize = cctx.unwrap(res, "Compression failed");
-            compressed.resize(cSize);
-            return compressed;
-        }));
+    // Complete the carried chunk of an appended archive
+    size_t chunkSize = toRead;
+    if (!carry_.empty()) {
+        tracezl::PooledBuffer joined = ctx_.buffers->acquire(carry_.size() + toRead);
+        std::memcpy(joined.data(), carry_.data(), carry_.size());
+        std::memcpy(joined.data() + carry_.size(), chunkData, toRead);
+        chunkSize = joined.size();
+        buffer = std::move(joined);
+        chunkData = buffer.data();
+        carry_ = {};
+    }
+    readTimer.stop(tracezl::STAGE_READ);
 
-        std::cout << "\rSubmitted: " << (processed * 100 / totalSize) << "%" << std::flush;
+    // A trailing partial record cannot go through the field splitter; it is
+    // stored raw in a chunk of its own, which a later --append picks up again
+    const size_t tail = eof_ ? chunkSize % tracezl::recordSize(ctx_.options.format) : 0;
+    tracezl::PooledBuffer tailBuffer;
+    if (tail) {
+        tailBuffer = ctx_.buffers->acquire(tail);
+        std::memcpy(tailBuffer.data(), chunkData + chunkSize - tail, tail);
+    }
+    size_t queued = 0;
+    if (chunkSize > tail) {
+        submitChunk(pool, std::move(buffer), chunkData, chunkSize - tail, false);
+        ++queued;
+    }
+    if (tail) {
+        const char* tailData = tailBuffer.data();
+        submitChunk(pool, std::move(tailBuffer), tailData, tail, true);
+        ++queued;
     }
+    return queued;
+}
+
+void CompressJob::submitChunk(openzl::training::ThreadPool& pool, tracezl::PooledBuffer owned,
+                              const char* chunkData, size_t size, bool stored) {
+    // Submit task
+    // We capture compressor by raw pointer. The main thread outlives the tasks.
+    // chunkData points into the mapping or into owned's heap storage, which
+    // moves into the task unchanged.
+    openzl::Compressor* rawCompressor = ctx_.compressor.get();
+    openzl::Compressor* rawFieldCompressor = ctx_.fieldCompressor.get();
+    auto chunkStats =
+        ctx_.stats && !stored ? std::make_unique<tracezl::CompressStats>() : nullptr;
+
+    auto result = pool.run([rawCompressor, rawFieldCompressor, buffers = ctx_.buffers,
+                            owned = std::move(owned), chunkData, size, stored,
+                            format = ctx_.options.format, columnar = ctx_.options.columnar,
+                            chunkStats = chunkStats.get()]() -> CompressedChunk {
+        const uint64_t checksum = tracezl::xxh64(chunkData, size);
+        if (stored) return {tracezl::storeChunk(chunkData, size, *buffers), checksum};
+
+        tracezl::ThreadStatsScope scope(chunkStats);
+        tracezl::StageTimer timer(chunkStats);
+        tracezl::PooledBuffer frame =
+            columnar ? tracezl::compressColumns(*rawFieldCompressor, format, chunkData, size,
+                                                *buffers)
+                     : tracezl::compressChunk(*rawCompressor, chunkData, size, *buffers);
+        timer.stop(tracezl::STAGE_CODEC);
+        return {std::move(frame), checksum};
+    });
+    futures_.push_back({std::move(result), size, std::move(chunkStats)});
+}
+
+void CompressJob::writeFront() {
+    PendingChunk& chunk = futures_.front();
+    CompressedChunk compressed = chunk.result.get();
+    const tracezl::PooledBuffer& result = compressed.frame;
+    index_.add({.compressedOffset = framesStart_ + totalCompressed_,
+                .compressedSize = result.size(),
+                .uncompressedOffset = index_.totalUncompressed(),
+                .uncompressedSize = chunk.size,
+                .numInstrs = chunk.size / tracezl::recordSize(ctx_.options.format),
+                .checksum = compressed.checksum});
+    if (chunk.stats) ctx_.stats->merge(*chunk.stats);
+    futures_.pop_front();
+
+    tracezl::StageTimer timer(ctx_.stats);
+    output_->stream().write(result.data(), result.size());
+    timer.stop(tracezl::STAGE_WRITE);
+    totalCompressed_ += result.size();
+}
 
+void CompressJob::finish() {
     // Drain remaining futures
-    while (!futures.empty()) {
-        std::string result = futures.front().get();
-        futures.pop_front();
-        outFile.write(result.data(), result.size());
-        totalCompressed += result.size();
+    while (hasPending()) {
+        writeFront();
+    }
+
+    // Append the chunk index so readers can seek straight to any instruction
+    std::ostream& outFile = output_->stream();
+    tracezl::writeChunkIndex(outFile, index_, framesStart_ + totalCompressed_);
+    const size_t archiveEnd = output_->isStdout() ? 0 : (size_t)outFile.tellp();
+    if (!output_->isStdout()) tracezl::patchArchiveInstrs(outFile, index_.totalInstrs());
+    outFile.flush();
+    if (!outFile) throw std::runtime_error("Failed to write output file");
+
+    // An append shorter than what it wrote over leaves old bytes past the trailer
+    if (!appendPath_.empty() && archiveEnd < archiveSize_) {
+        output_.reset();
+        std::filesystem::resize_file(appendPath_, archiveEnd);
+    }
+    finished_ = true;
+}
+
+// Smallest chunk --max-memory shrinks to before it cuts the queue depth instead
+constexpr size_t kMinBudgetChunk = 1 << 20;
+
+// Estimated peak memory of one chunk in flight: the input chunk, the
+// worst-case output buffer, and the field streams and intermediate buffers
+// OpenZL allocates while compressing, taken as twice the chunk. The buffer
+// pool keeps no more buffers than were in use at once, so this covers them.
+size_t chunkFootprint(size_t chunkBytes) {
+    return chunkBytes + ZL_compressBound(chunkBytes) + 2 * chunkBytes;
+}
+
+// Memory held by a ChunkReader on top of the chunks in flight
+size_t readerFootprint(size_t chunkBytes, bool streamed) {
+    return streamed ? tracezl::ChunkReader::kHeldChunks * chunkBytes : 0;
+}
+
+// Whether a trace is read through a ChunkReader instead of memory mapped,
+// as CompressJob decides
+bool readsThroughReader(const std::string& trace_path, const CompressOptions& options) {
+    if (!options.use_mmap || !tracezl::isRegularFile(trace_path)) return true;
+    std::ifstream in(trace_path, std::ios::binary);
+    char magic[8] = {};
+    in.read(magic, sizeof(magic));
+    return tracezl::detectInputCodec(magic, in.gcount()) != tracezl::InputCodec::None;
+}
+
+// `streamed` when any input goes through a ChunkReader, whose read-ahead
+// counts against --max-memory
+CompressContext makeContext(const std::string& config_path, const CompressOptions& options,
+                            bool streamed, tracezl::CompressStats* stats,
+                            tracezl::BufferPool& buffers, std::ostream& log) {
+    // Load config, picking one level of a multi-level config
+    const std::vector<tracezl::ConfigLevel> levels =
+        tracezl::parseLevels(tracezl::loadConfig(config_path));
+    const tracezl::ConfigLevel& level = options.target_mbps > 0
+                                            ? tracezl::selectLevel(levels, options.target_mbps)
+                                            : tracezl::selectLevel(levels, options.level);
+    if (levels.size() > 1) {
+        log << "Using level " << (&level - levels.data()) << " of " << levels.size() << " (ratio "
+            << level.ratio() << ", " << level.compressMBps()
+            << " MB/s per thread on the training samples)" << std::endl;
+    }
+
+    CompressContext ctx = {.options = options, .configData = level.config};
+    ctx.buffers = &buffers;
+    ctx.compressor = tracezl::createCompressorFromSerialized(ctx.configData, options.format);
+    ctx.compressor->setParameter(openzl::CParam::FormatVersion, ZL_MAX_FORMAT_VERSION);
+
+    if (options.columnar) ctx.fieldCompressor = tracezl::createStreamCompressor();
+    // With --stats every chunk gets its own stats, merged as it is written
+    ctx.stats = stats;
+
+    const size_t recordSize = tracezl::recordSize(options.format);
+    size_t chunkSize = options.chunk_size;
+    ctx.queueDepth = options.max_inflight ? options.max_inflight : options.num_threads * 2;
+
+    // Fit the wanted queue depth into the budget by shrinking chunks first;
+    // past kMinBudgetChunk fewer chunks are kept in flight instead, which
+    // costs throughput but not the process.
+    if (options.max_memory) {
+        while (chunkSize > kMinBudgetChunk &&
+               ctx.queueDepth * chunkFootprint(chunkSize) + readerFootprint(chunkSize, streamed) >
+                   options.max_memory) {
+            chunkSize = std::max(chunkSize / 2, kMinBudgetChunk);
+        }
+    }
+    ctx.chunkBytes = std::max<size_t>(chunkSize / recordSize, 1) * recordSize;
+    if (options.max_memory) {
+        const size_t reader = readerFootprint(ctx.chunkBytes, streamed);
+        const size_t fits = options.max_memory > reader
+                                ? (options.max_memory - reader) / chunkFootprint(ctx.chunkBytes)
+                                : 0;
+        if (fits == 0) {
+            log << "Warning: --max-memory is below the footprint of a single chunk" << std::endl;
+        }
+        ctx.queueDepth = std::clamp<size_t>(fits, 1, ctx.queueDepth);
+        log << "Memory budget " << (options.max_memory >> 20) << " MB: " << ctx.queueDepth
+            << " chunks of " << (ctx.chunkBytes >> 10) << " KB in flight" << std::endl;
+    }
+    return ctx;
+}
+
+// Compression ratio; an empty input writes no frames
+double ratio(size_t processed, size_t compressed) {
+    return compressed ? (double)processed / compressed : 0.0;
+}
+
+void reportStats(std::ostream& log, const CompressOptions& options,
+                 const tracezl::CompressStats& stats, size_t processed, size_t compressed,
+                 std::chrono::steady_clock::time_point start) {
+    const double elapsed =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (options.stats) {
+        tracezl::printStats(log, stats, options.format, options.columnar, processed, compressed,
+                            elapsed);
+    }
+    if (!options.stats_json.empty()) {
+        tracezl::OutputFile statsFile(options.stats_json);
+        tracezl::printStatsJson(statsFile.stream(), stats, options.format, options.columnar,
+                                processed, compressed, elapsed);
+    }
+}
+
+}  // namespace
+
+void compress_trace(const std::string& trace_path, const std::string& output_path,
+                    const std::string& config_path, const CompressOptions& options) {
+    const size_t num_threads = options.num_threads;
+    std::ostream& log = tracezl::logStream(output_path);
+    log << (options.append ? "Appending " : "Compressing ") << tracezl::formatName(options.format)
+        << " trace " << trace_path << (options.append ? " to " + output_path : "") << " with "
+        << num_threads << " threads..." << std::endl;
+
+    const bool collectStats = options.stats || !options.stats_json.empty();
+    tracezl::CompressStats stats;
+    const auto start = std::chrono::steady_clock::now();
+    tracezl::BufferPool buffers;
+    const CompressContext ctx =
+        makeContext(config_path, options, readsThroughReader(trace_path, options),
+                    collectStats ? &stats : nullptr, buffers, log);
+    CompressJob job(trace_path, output_path, ctx);
+    if (job.inputCodec() != tracezl::InputCodec::None) {
+        log << "Decoding " << tracezl::inputCodecName(job.inputCodec()) << " input on the fly"
+            << std::endl;
+    }
+
+    // Thread Pool
+    openzl::training::ThreadPool pool(num_threads);
+
+    size_t inflight = 0;
+    while (true) {
+        // Flow control: while the queue is full, write results
+        while (inflight >= ctx.queueDepth) {
+            job.writeFront();
+            --inflight;
+        }
+        const size_t queued = job.submitNext(pool);
+        if (!queued) break;
+        inflight += queued;
+
+        if (job.totalSize() && *job.totalSize() > 0) {
+            log << "\rSubmitted: " << (job.processed() * 100 / *job.totalSize()) << "%"
+                << std::flush;
+        } else {
+            log << "\rSubmitted: " << (job.processed() >> 20) << " MB" << std::flush;
+        }
+    }
+    job.finish();
+
+    log << std::endl;
+    log << "Compressed size: " << job.totalCompressed()
+        << " bytes (Ratio: " << ratio(job.processed(), job.totalCompressed()) << ")"
+        << std::endl;
+
+    if (collectStats) {
+        reportStats(log, options, stats, job.processed(), job.totalCompressed(), start);
+    }
+}
+
+void compress_batch(const std::string& list_path, const std::string& out_dir,
+                    const std::string& config_path, const CompressOptions& options) {
+    if (options.append) throw std::runtime_error("--append takes a single trace, not --batch");
+
+    // One trace path per line; blank lines and '#' comments are skipped
+    std::ifstream list(list_path);
+    if (!list) throw std::runtime_error("Cannot open batch list " + list_path);
+    struct BatchEntry {
+        std::string trace;
+        std::string output;
+        uintmax_t size;
+    };
+    std::vector<BatchEntry> entries;
+    std::set<std::string> outputs;
+    std::string line;
+    while (std::getline(list, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::filesystem::path trace(line);
+        std::string output = (std::filesystem::path(out_dir) / trace.filename()).string() + ".zl";
+        if (!outputs.insert(output).second) {
+            throw std::runtime_error("Two traces in the batch map to " + output);
+        }
+        entries.push_back({line, output, std::filesystem::file_size(trace)});
+    }
+
+    // Largest first, so the long tail of small traces fills in around them
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const BatchEntry& a, const BatchEntry& b) { return a.size > b.size; });
+    std::filesystem::create_directories(out_dir);
+
+    const size_t num_threads = options.num_threads;
+    std::cout << "Compressing " << entries.size() << " traces into " << out_dir << " with "
+              << num_threads << " threads..." << std::endl;
+
+    const bool collectStats = options.stats || !options.stats_json.empty();
+    tracezl::CompressStats stats;
+    const auto start = std::chrono::steady_clock::now();
+    tracezl::BufferPool buffers;
+    const bool streamed =
+        std::any_of(entries.begin(), entries.end(), [&](const BatchEntry& entry) {
+            return readsThroughReader(entry.trace, options);
+        });
+    const CompressContext ctx = makeContext(config_path, options, streamed,
+                                            collectStats ? &stats : nullptr, buffers, std::cout);
+
+    // All traces share one pool and one bound on chunks in flight. Chunks are
+    // submitted trace after trace, so the oldest pending chunk always belongs
+    // to the oldest unfinished trace; writing it keeps every archive in
+    // order, while workers are already busy with the next traces' chunks.
+    openzl::training::ThreadPool pool(num_threads);
+    std::deque<std::unique_ptr<CompressJob>> active;
+    size_t inflight = 0;
+    size_t finished = 0;
+    size_t totalProcessed = 0;
+    size_t totalCompressed = 0;
+
+    auto finishOldest = [&]() {
+        CompressJob& job = *active.front();
+        job.finish();
+        totalProcessed += job.processed();
+        totalCompressed += job.totalCompressed();
+        std::cout << "[" << finished + 1 << "/" << entries.size() << "] "
+                  << entries[finished].output << " (Ratio: "
+                  << ratio(job.processed(), job.totalCompressed()) << ")" << std::endl;
+        ++finished;
+        active.pop_front();
+    };
+
+    // Write one chunk of the oldest trace. Traces with nothing left pending
+    // are closed first; the trace being submitted always has a pending chunk
+    // by the time it reaches the front here.
+    auto writeOldest = [&]() {
+        while (!active.front()->hasPending()) finishOldest();
+        active.front()->writeFront();
+        --inflight;
+    };
+
+    for (const BatchEntry& entry : entries) {
+        active.push_back(std::make_unique<CompressJob>(entry.trace, entry.output, ctx));
+        CompressJob& job = *active.back();
+        while (true) {
+            // Flow control across all traces
+            while (inflight >= ctx.queueDepth) writeOldest();
+            const size_t queued = job.submitNext(pool);
+            if (!queued) break;
+            inflight += queued;
+        }
     }
+    while (!active.empty()) finishOldest();
 
-    std::cout << std::endl;
-    std::cout << "Compressed size: " << totalCompressed
-              << " bytes (Ratio: " << (double)totalSize / totalCompressed << ")" << std::endl;
+    std::cout << "Compressed " << totalProcessed << " bytes into " << totalCompressed
+              << " bytes (Ratio: " << ratio(totalProcessed, totalCompressed) << ")"
+              << std::endl;
+    if (collectStats) {
+        reportStats(std::cout, options, stats, totalProcessed, totalCompressed, start);
+    }
 }
@@ -1,11 +1,105 @@
 #pragma once
+#include <cstdint>
+#include <limits>
 #include <string>
+#include <vector>
 
-void train_compressor(const std::string& trace_path, const std::string& config_path,
-                      size_t num_threads = 1);
+#include "trace_format.h"
+
+struct TrainOptions {
+    size_t num_threads = 1;
+    tracezl::TraceFormat format = tracezl::TraceFormat::ChampSim;
+    // Training samples are chunks of the size the config will compress
+    size_t chunk_size = 100 * 1024 * 1024;
+    // Chunks sampled evenly across all input traces
+    size_t num_samples = 16;
+    // Cap on sampled bytes; lowers num_samples when exceeded (0: no cap)
+    size_t max_memory = size_t(2) << 30;
+};
+
+struct CompressOptions {
+    // Level of a multi-level config: fast, balanced, max or a level number
+    std::string level = "max";
+    // When set, the best-ratio level that compressed at least this many MB/s
+    // per thread during training; overrides `level`
+    double target_mbps = 0;
+    size_t chunk_size = 100 * 1024 * 1024;
+    size_t num_threads = 1;
+    // Chunks read but not yet written out (0: twice the thread count)
+    size_t max_inflight = 0;
+    // Bound on memory held by chunks in flight (0: none). Shrinks the chunk
+    // size, then the number of chunks in flight, until the estimate fits.
+    size_t max_memory = 0;
+    // Compress regular files straight out of a read-only mapping
+    bool use_mmap = true;
+    // Record layout of the input; must match the one the config was trained on
+    tracezl::TraceFormat format = tracezl::TraceFormat::ChampSim;
+    // Store the config in the archive header, not just its hash
+    bool embed_config = false;
+    // Store each field stream of a chunk in its own frame, so readers can
+    // decode a subset of the fields
+    bool columnar = false;
+    // Add the trace to the end of an existing archive of the same config
+    // instead of creating one; only the new data is compressed
+    bool append = false;
+    // Print per-field sizes and per-stage times at the end
+    bool stats = false;
+    // Also write them as JSON to this path ("-" for stdout)
+    std::string stats_json;
+};
+
+struct DecompressOptions {
+    size_t num_threads = 1;
+    // Frames being decoded at once (0: twice the thread count)
+    size_t max_inflight = 0;
+    // Fields to decode; the others are written as zero
+    tracezl::FieldMask fields = tracezl::kAllFields;
+};
+
+struct SummaryOptions {
+    size_t num_threads = 1;
+    // Print a JSON object on stdout instead of a table
+    bool json = false;
+};
+
+struct BenchOptions {
+    // Level of a multi-level config, as for compress
+    std::string level = "max";
+    std::vector<size_t> chunk_sizes = {100 * 1024 * 1024};
+    std::vector<size_t> thread_counts = {1};
+    tracezl::TraceFormat format = tracezl::TraceFormat::ChampSim;
+    // Timed runs per sweep point; the fastest is reported
+    size_t repeat = 3;
+    // Also time the field splitter's transpose kernels at each SIMD level,
+    // on the first chunk size
+    bool kernels = false;
+    // Print a JSON report on stdout instead of a table
+    bool json = false;
+};
+
+void train_compressor(const std::vector<std::string>& trace_paths, const std::string& config_path,
+                      const TrainOptions& options = {});
+// A trace_path or output_path of "-" streams from stdin / to stdout
 void compress_trace(const std::string& trace_path, const std::string& output_path,
-                    const std::string& config_path, size_t chunk_size = 100 * 1024 * 1024,
-                    size_t num_threads = 1);
+                    const std::string& config_path, const CompressOptions& options = {});
+// Compress every trace listed in `list_path`, one path per line, into
+// `out_dir`/<file name>.zl. The config is loaded once and chunks of all traces
+// share one thread pool, largest trace first.
+void compress_batch(const std::string& list_path, const std::string& out_dir,
+                    const std::string& config_path, const CompressOptions& options = {});
+// Decoding needs no config: everything it needs is in the archive
 void decompress_trace(const std::string& compressed_path, const std::string& output_path,
-                      const std::string& config_path, size_t chunk_size = 100 * 1024 * 1024,
-                      size_t num_threads = 1);
+                      const DecompressOptions& options = {});
+void extract_trace(const std::string& compressed_path, const std::string& output_path,
+                   uint64_t skip = 0, uint64_t count = std::numeric_limits<uint64_t>::max(),
+                   size_t num_threads = 1, tracezl::FieldMask fields = tracezl::kAllFields);
+// Decode every chunk in parallel and check it against its index entry and
+// checksum without writing anything; throws if any chunk fails
+void verify_archive(const std::string& compressed_path, size_t num_threads = 1);
+// Decode an archive in parallel and print instruction, branch, footprint,
+// memory mix and register statistics without writing the trace out
+void summarize_trace(const std::string& compressed_path, const SummaryOptions& options = {});
+// Compress and decompress a trace in memory for every chunk size and thread
+// count combination, reporting throughput, ratio and peak RSS
+void bench_trace(const std::string& trace_path, const std::string& config_path,
+                 const BenchOptions& options = {});
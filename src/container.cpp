@@ -0,0 +1,259 @@
+#include "container.h"
+
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+#include "checksum.h"
+#include "columnar.h"
+#include "little_endian.h"
+
+namespace tracezl {
+
+namespace {
+
+constexpr size_t kEntrySize = 6 * sizeof(uint64_t);
+
+void readAt(std::istream& in, uint64_t offset, char* dst, size_t size) {
+    in.clear();
+    in.seekg(offset);
+    in.read(dst, size);
+    if ((size_t)in.gcount() != size) {
+        throw std::runtime_error("Unexpected EOF reading archive at offset " +
+                                 std::to_string(offset));
+    }
+}
+
+}  // namespace
+
+size_t ArchiveHeader::size() const {
+    return kArchiveHeaderSize + ((flags & ARCHIVE_EMBEDDED_CONFIG) ? config.size() : 0);
+}
+
+void writeArchiveHeader(std::ostream& out, const ArchiveHeader& header) {
+    std::string block(kArchiveHeaderSize, '\0');
+    char* p = block.data();
+    storeLE32(p, kArchiveMagic);
+    storeLE16(p + 4, kArchiveVersion);
+    storeLE16(p + 6, (uint16_t)header.format);
+    storeLE32(p + 8, header.flags);
+    storeLE32(p + 12, (uint32_t)header.size());
+    storeLE64(p + kArchiveInstrsOffset, header.numInstrs);
+    storeLE64(p + 24, header.configHash);
+    if (header.flags & ARCHIVE_EMBEDDED_CONFIG) block += header.config;
+
+    out.write(block.data(), block.size());
+}
+
+void patchArchiveInstrs(std::ostream& out, uint64_t numInstrs) {
+    char value[8];
+    storeLE64(value, numInstrs);
+    out.seekp(kArchiveInstrsOffset);
+    out.write(value, sizeof(value));
+    out.seekp(0, std::ios::end);
+}
+
+std::optional<ArchiveHeader> parseArchiveHeader(const void* data, size_t size,
+                                                size_t* totalSize) {
+    const char* p = (const char*)data;
+    if (size < kArchiveHeaderSize || loadLE32(p) != kArchiveMagic) return std::nullopt;
+
+    const uint16_t version = loadLE16(p + 4);
+    if (version != kArchiveVersion) {
+        throw std::runtime_error("Unsupported archive version " + std::to_string(version));
+    }
+    const auto format = formatFromId(loadLE16(p + 6));
+    if (!format) throw std::runtime_error("Corrupt archive header: unknown trace format");
+
+    ArchiveHeader header;
+    header.format = *format;
+    header.flags = loadLE32(p + 8);
+    header.numInstrs = loadLE64(p + kArchiveInstrsOffset);
+    header.configHash = loadLE64(p + 24);
+    *totalSize = loadLE32(p + 12);
+    if (*totalSize < kArchiveHeaderSize) {
+        throw std::runtime_error("Corrupt archive header: bad header size");
+    }
+    return header;
+}
+
+ArchiveHeader readArchiveHeader(std::istream& in, uint64_t fileSize) {
+    std::optional<ArchiveHeader> header;
+    size_t totalSize = 0;
+    if (fileSize >= kArchiveHeaderSize) {
+        char fixed[kArchiveHeaderSize];
+        readAt(in, 0, fixed, kArchiveHeaderSize);
+        header = parseArchiveHeader(fixed, kArchiveHeaderSize, &totalSize);
+    }
+    if (!header) throw std::runtime_error("Not a tracezl archive: no archive header");
+    if (totalSize > fileSize) throw std::runtime_error("Corrupt archive header: bad header size");
+
+    if (header->flags & ARCHIVE_EMBEDDED_CONFIG) {
+        header->config.resize(totalSize - kArchiveHeaderSize);
+        readAt(in, kArchiveHeaderSize, header->config.data(), header->config.size());
+    }
+    return *header;
+}
+
+void ChunkIndex::add(const ChunkIndexEntry& entry) {
+    firstInstrs_.push_back(totalInstrs());
+    entries_.push_back(entry);
+}
+
+bool ChunkIndex::checksumMatches(size_t chunk, const void* data, size_t size) const {
+    return !hasChecksums_ || xxh64(data, size) == entries_[chunk].checksum;
+}
+
+uint64_t ChunkIndex::framesEnd() const {
+    if (entries_.empty()) return 0;
+    return entries_.back().compressedOffset + entries_.back().compressedSize;
+}
+
+uint64_t ChunkIndex::totalInstrs() const {
+    if (entries_.empty()) return 0;
+    return firstInstrs_.back() + entries_.back().numInstrs;
+}
+
+uint64_t ChunkIndex::totalUncompressed() const {
+    if (entries_.empty()) return 0;
+    return entries_.back().uncompressedOffset + entries_.back().uncompressedSize;
+}
+
+size_t ChunkIndex::findChunk(uint64_t instr) const {
+    if (instr >= totalInstrs()) return entries_.size();
+    // Last chunk whose first instruction is <= instr
+    auto it = std::upper_bound(firstInstrs_.begin(), firstInstrs_.end(), instr);
+    return (size_t)(it - firstInstrs_.begin()) - 1;
+}
+
+void writeChunkIndex(std::ostream& out, const ChunkIndex& index, uint64_t indexOffset) {
+    // Only a scanned index lacks checksums, and it is never written back
+    if (!index.hasChecksums()) throw std::runtime_error("Chunk index has no checksums to write");
+    std::string block(kIndexHeaderSize + index.size() * kEntrySize + kTrailerSize, '\0');
+    char* p = block.data();
+
+    storeLE32(p, kIndexMagic);
+    storeLE16(p + 4, kIndexVersion);
+    storeLE16(p + 6, (uint16_t)index.format());
+    storeLE64(p + 8, index.size());
+    p += kIndexHeaderSize;
+
+    for (const ChunkIndexEntry& entry : index.entries()) {
+        storeLE64(p, entry.compressedOffset);
+        storeLE64(p + 8, entry.compressedSize);
+        storeLE64(p + 16, entry.uncompressedOffset);
+        storeLE64(p + 24, entry.uncompressedSize);
+        storeLE64(p + 32, entry.numInstrs);
+        storeLE64(p + 40, entry.checksum);
+        p += kEntrySize;
+    }
+
+    storeLE64(p, indexOffset);
+    storeLE64(p + 8, kTrailerMagic);
+
+    out.write(block.data(), block.size());
+}
+
+std::optional<ChunkIndex> readChunkIndex(std::istream& in, uint64_t fileSize) {
+    if (fileSize < kIndexHeaderSize + kTrailerSize) return std::nullopt;
+
+    char trailer[kTrailerSize];
+    readAt(in, fileSize - kTrailerSize, trailer, kTrailerSize);
+    if (loadLE64(trailer + 8) != kTrailerMagic) return std::nullopt;
+
+    const uint64_t indexOffset = loadLE64(trailer);
+    if (indexOffset > fileSize - kTrailerSize - kIndexHeaderSize) {
+        throw std::runtime_error("Corrupt chunk index: bad index offset");
+    }
+    std::string block(fileSize - indexOffset, '\0');
+    readAt(in, indexOffset, block.data(), block.size());
+    return parseChunkIndex(block.data(), block.size(), indexOffset);
+}
+
+ChunkIndex parseChunkIndex(const void* data, size_t size, uint64_t indexOffset) {
+    const char* const block = (const char*)data;
+    if (size < kIndexHeaderSize + kTrailerSize || loadLE32(block) != kIndexMagic) {
+        throw std::runtime_error("Corrupt chunk index: bad index magic");
+    }
+    const char* const trailer = block + size - kTrailerSize;
+    if (loadLE64(trailer + 8) != kTrailerMagic || loadLE64(trailer) != indexOffset) {
+        throw std::runtime_error("Corrupt chunk index: bad trailer");
+    }
+    const uint16_t version = loadLE16(block + 4);
+    if (version != kIndexVersion) {
+        throw std::runtime_error("Unsupported chunk index version " + std::to_string(version));
+    }
+    const auto format = formatFromId(loadLE16(block + 6));
+    if (!format) throw std::runtime_error("Corrupt chunk index: unknown trace format");
+    const uint64_t numEntries = loadLE64(block + 8);
+    const size_t entriesSize = size - kIndexHeaderSize - kTrailerSize;
+    if (entriesSize % kEntrySize != 0 || numEntries != entriesSize / kEntrySize) {
+        throw std::runtime_error("Corrupt chunk index: entry count mismatch");
+    }
+
+    ChunkIndex index(*format);
+    for (uint64_t i = 0; i < numEntries; ++i) {
+        const char* p = block + kIndexHeaderSize + i * kEntrySize;
+        ChunkIndexEntry entry = {.compressedOffset = loadLE64(p),
+                                 .compressedSize = loadLE64(p + 8),
+                                 .uncompressedOffset = loadLE64(p + 16),
+                                 .uncompressedSize = loadLE64(p + 24),
+                                 .numInstrs = loadLE64(p + 32),
+                                 .checksum = loadLE64(p + 40)};
+        // Subtraction form: the sum of two damaged fields can wrap
+        if (entry.compressedSize > indexOffset ||
+            entry.compressedOffset > indexOffset - entry.compressedSize) {
+            throw std::runtime_error("Corrupt chunk index: entry " + std::to_string(i) +
+                                     " points past the frame region");
+        }
+        index.add(entry);
+    }
+    return index;
+}
+
+bool isIndexBlock(const void* data, size_t size) {
+    return size >= 4 && loadLE32((const char*)data) == kIndexMagic;
+}
+
+ChunkIndex scanChunkIndex(std::istream& in, uint64_t fileSize) {
+    const ArchiveHeader archiveHeader = readArchiveHeader(in, fileSize);
+    const TraceFormat format = archiveHeader.format;
+    ChunkIndex index(format, false);
+    uint64_t offset = archiveHeader.size();
+    uint64_t uncompressedOffset = 0;
+    std::string header;
+
+    while (offset < fileSize) {
+        // Chunk headers are small; grow the probe until the chunk can be sized
+        size_t probe = 64;
+        std::optional<ChunkSizes> sizes;
+        while (true) {
+            probe = std::min<uint64_t>(probe, fileSize - offset);
+            header.resize(probe);
+            readAt(in, offset, header.data(), probe);
+            if (isIndexBlock(header.data(), probe)) return index;
+
+            sizes = probeChunk(header.data(), probe, format);
+            if (sizes) break;
+            if (offset + probe == fileSize) {
+                throw std::runtime_error(
+                    "Corrupt compressed file or truncated frame header at offset " +
+                    std::to_string(offset));
+            }
+            probe *= 4;
+        }
+
+        index.add({.compressedOffset = offset,
+                   .compressedSize = sizes->compressed,
+                   .uncompressedOffset = uncompressedOffset,
+                   .uncompressedSize = sizes->decompressed,
+                   .numInstrs = sizes->decompressed / recordSize(format)});
+        offset += sizes->compressed;
+        uncompressedOffset += sizes->decompressed;
+    }
+    return index;
+}
+
+}  // namespace tracezl
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "trace_format.h"
+
+namespace tracezl {
+
+// A .zl archive is an archive header, a sequence of chunks, a chunk index
+// and a fixed-size trailer:
+//
+//   [header][chunk 0][chunk 1]...[chunk N-1][index block][trailer]
+//
+// Each chunk is one OpenZL frame or, in columnar archives, a column group of
+// one frame per field stream. A trailing partial record is a stored chunk
+// (see columnar.h).
+//
+// The header describes the archive without reading the rest of it. Its fixed
+// part is the u32 kArchiveMagic, u16 version, u16 TraceFormat, u32 flags, u32
+// total header size, u64 instruction count (kUnknownInstrs when the archive
+// was written to a pipe) and the u64 XXH64 of the config used to compress.
+// With ARCHIVE_EMBEDDED_CONFIG the config itself follows, up to the header
+// size.
+//
+// The index block starts with kIndexMagic so a forward scan can tell it apart
+// from the next frame. The trailer holds the absolute offset of the index
+// block and kTrailerMagic so a seekable reader can find it from the end.
+//
+// The index header is the magic, a u16 version, the u16 TraceFormat of the
+// records and the u64 entry count. Each entry ends with the XXH64 of the
+// chunk's uncompressed bytes. Only the current version is read.
+constexpr uint32_t kIndexMagic = 0x494C5A54;              // "TZLI"
+constexpr uint16_t kIndexVersion = 3;
+constexpr uint64_t kTrailerMagic = 0x5245544F4F464C5AULL;  // "ZLFOOTER"
+constexpr size_t kIndexHeaderSize = 16;
+constexpr size_t kTrailerSize = 16;
+
+constexpr uint32_t kArchiveMagic = 0x414C5A54;  // "TZLA"
+constexpr uint16_t kArchiveVersion = 1;
+constexpr size_t kArchiveHeaderSize = 32;
+constexpr size_t kArchiveInstrsOffset = 16;
+constexpr uint64_t kUnknownInstrs = UINT64_MAX;
+
+enum ArchiveFlags : uint32_t {
+    // The serialized config follows the fixed header
+    ARCHIVE_EMBEDDED_CONFIG = 1 << 0,
+    // Chunks are column groups
+    ARCHIVE_COLUMNAR = 1 << 1,
+};
+
+struct ArchiveHeader {
+    TraceFormat format = TraceFormat::ChampSim;
+    uint32_t flags = 0;
+    uint64_t numInstrs = kUnknownInstrs;
+    uint64_t configHash = 0;
+    std::string config;  // empty unless ARCHIVE_EMBEDDED_CONFIG
+
+    // Bytes the header occupies at the start of the archive
+    size_t size() const;
+};
+
+// Serialize the archive header
+void writeArchiveHeader(std::ostream& out, const ArchiveHeader& header);
+
+// Overwrite the instruction count of a header written at the start of a
+// seekable stream
+void patchArchiveInstrs(std::ostream& out, uint64_t numInstrs);
+
+// Parse the fixed part of a header from the first bytes of an archive.
+// Returns nullopt if they do not start with a header; the embedded config is
+// left empty and `totalSize` receives the size of the whole header.
+std::optional<ArchiveHeader> parseArchiveHeader(const void* data, size_t size,
+                                                size_t* totalSize);
+
+// Read the header, including any embedded config, at the start of a seekable
+// archive. Throws if the file does not start with one.
+ArchiveHeader readArchiveHeader(std::istream& in, uint64_t fileSize);
+
+// Location of one compressed chunk
+struct ChunkIndexEntry {
+    uint64_t compressedOffset;    // offset of the frame in the archive
+    uint64_t compressedSize;      // size of the frame
+    uint64_t uncompressedOffset;  // offset of the chunk in the original trace
+    uint64_t uncompressedSize;    // size of the chunk once decompressed
+    uint64_t numInstrs;           // whole records in the chunk
+    uint64_t checksum = 0;        // XXH64 of the chunk once decompressed
+};
+
+class ChunkIndex {
+public:
+    explicit ChunkIndex(TraceFormat format = TraceFormat::ChampSim, bool hasChecksums = true)
+        : format_(format), hasChecksums_(hasChecksums) {}
+
+    void add(const ChunkIndexEntry& entry);
+
+    // Record layout of the archived trace
+    TraceFormat format() const { return format_; }
+    // False for indexes rebuilt by scanChunkIndex(), which cannot be written
+    bool hasChecksums() const { return hasChecksums_; }
+    // Whether the decompressed bytes of chunk `chunk` match its checksum;
+    // always true without checksums
+    bool checksumMatches(size_t chunk, const void* data, size_t size) const;
+
+    const std::vector<ChunkIndexEntry>& entries() const { return entries_; }
+    size_t size() const { return entries_.size(); }
+    const ChunkIndexEntry& operator[](size_t chunk) const { return entries_[chunk]; }
+
+    // End of the frame region, i.e. where the index block starts
+    uint64_t framesEnd() const;
+    uint64_t totalInstrs() const;
+    uint64_t totalUncompressed() const;
+
+    // First instruction stored in chunk `chunk`
+    uint64_t firstInstr(size_t chunk) const { return firstInstrs_[chunk]; }
+    // Index of the chunk holding instruction `instr`, or size() if the
+    // archive is shorter than that.
+    size_t findChunk(uint64_t instr) const;
+
+private:
+    TraceFormat format_;
+    bool hasChecksums_;
+    std::vector<ChunkIndexEntry> entries_;
+    std::vector<uint64_t> firstInstrs_;
+};
+
+// Serialize the index block and trailer. `indexOffset` is the position in the
+// archive at which the block is written.
+void writeChunkIndex(std::ostream& out, const ChunkIndex& index, uint64_t indexOffset);
+
+// Read the index of a seekable archive of `fileSize` bytes. Returns nullopt if
+// the archive has no trailer, i.e. it was cut short or damaged.
+std::optional<ChunkIndex> readChunkIndex(std::istream& in, uint64_t fileSize);
+
+// Parse an index block and its trailer, `size` bytes in all, written at
+// archive offset `indexOffset`. Throws if they are damaged.
+ChunkIndex parseChunkIndex(const void* data, size_t size, uint64_t indexOffset);
+
+// Whether `data` starts with an index block
+bool isIndexBlock(const void* data, size_t size);
+
+// Rebuild the index of an archive without a trailer by walking its frames.
+// The format comes from the archive header, which must be present. The
+// rebuilt index has no checksums.
+ChunkIndex scanChunkIndex(std::istream& in, uint64_t fileSize);
+
+}  // namespace tracezl
@@ -1,149 +1,277 @@
+#include <cstring>
 #include <deque>
 #include <fstream>
 #include <future>
 #include <iostream>
+#include <iterator>
+#include <optional>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
-#include "common.h"
+#include "checksum.h"
+#include "columnar.h"
 #include "compressor.h"
-#include "openzl/cpp/DCtx.hpp"
-#include "openzl/zl_decompress.h"
+#include "container.h"
+#include "io.h"
 #include "tools/training/utils/thread_pool.h"
 
 // Removed using namespace
 
-void decompress_trace(const std::string& compressed_path, const std::string& output_path,
-                      const std::string& config_path, size_t chunk_size, size_t num_threads) {
-    std::cout << "Decompressing " << compressed_path << " to " << output_path << " with "
-              << num_threads << " threads..." << std::endl;
-
-    // Load config
-    std::ifstream configFile(config_path, std::ios::binary | std::ios::ate);
-    if (!configFile) throw std::runtime_error("Cannot open config file");
-    size_t configSize = configFile.tellg();
-    configFile.seekg(0);
-    std::string configData(configSize, '\0');
-    configFile.read(&configData[0], configSize);
+namespace {
 
-    auto compressor = tracezl::createCompressorFromSerialized(configData);
-
-    // Open Files
+// Both ends are regular files: every frame's position in the archive and in
+// the output is known from the chunk index, so workers decode straight into
+// their slice of a pre-sized, memory mapped output file. At most
+// max_inflight frames are decoding at once.
+size_t decompressToFile(const std::string& compressed_path, const std::string& output_path,
+                        const DecompressOptions& options, std::ostream& log) {
     std::ifstream compFile(compressed_path, std::ios::binary | std::ios::ate);
     if (!compFile) throw std::runtime_error("Cannot open compressed file");
     size_t compFileSize = compFile.tellg();
-    compFile.seekg(0);
 
-    std::ofstream outFile(output_path, std::ios::binary);
-    if (!outFile) throw std::runtime_error("Cannot open output file");
+    auto index = tracezl::readChunkIndex(compFile, compFileSize);
+    if (!index) {
+        log << "No chunk index found, scanning frames..." << std::endl;
+        index = tracezl::scanChunkIndex(compFile, compFileSize);
+    }
+
+    tracezl::MappedFile input(compressed_path);
+    tracezl::MappedOutputFile output(output_path, index->totalUncompressed());
 
     // Thread Pool
-    openzl::training::ThreadPool pool(num_threads);
-    std::deque<std::future<std::string>> futures;
-    const size_t max_queue_size = num_threads * 2;
+    tracezl::BufferPool buffers;
+    openzl::training::ThreadPool pool(options.num_threads);
+    std::deque<std::future<void>> futures;
+    const size_t max_queue_size =
+        options.max_inflight ? options.max_inflight : options.num_threads * 2;
+    const tracezl::TraceFormat format = index->format();
 
-    // Buffer for reading compressed data
-    std::vector<char> buffer;
-    buffer.reserve(chunk_size + 4096);
+    // Projected chunks differ from what was hashed, so only full decodes are checked
+    const bool checkChecksums = options.fields == tracezl::kAllFields;
 
-    size_t bufferPos = 0;
-    size_t compProcessed = 0;
-    size_t totalDecompressed = 0;
+    // Nothing is written here; waiting only reports progress and errors
+    size_t decoded = 0;
+    auto waitFront = [&]() {
+        futures.front().get();
+        futures.pop_front();
+        ++decoded;
+        log << "\rDecoded: " << (decoded * 100 / index->size()) << "%" << std::flush;
+    };
 
-    while (true) {
+    for (size_t chunk = 0; chunk < index->size(); ++chunk) {
         // Flow control
         if (futures.size() >= max_queue_size) {
-            std::string result = futures.front().get();
-            futures.pop_front();
-            outFile.write(result.data(), result.size());
-            totalDecompressed += result.size();
+            waitFront();
         }
 
-        // Ensure we have data
-        if (buffer.size() - bufferPos < 64) {
-            if (bufferPos > 0) {
-                buffer.erase(buffer.begin(), buffer.begin() + bufferPos);
-                bufferPos = 0;
+        const tracezl::ChunkIndexEntry& entry = (*index)[chunk];
+        if (entry.uncompressedSize > output.size() ||
+            entry.uncompressedOffset > output.size() - entry.uncompressedSize) {
+            throw std::runtime_error("Corrupt chunk index: chunk ends past the output");
+        }
+        const char* src = input.data() + entry.compressedOffset;
+        char* dst = output.data() + entry.uncompressedOffset;
+        futures.push_back(pool.run([&, src, dst, chunk, entry]() {
+            size_t dSize = tracezl::decodeChunk(format, options.fields, src,
+                                                entry.compressedSize, dst,
+                                                entry.uncompressedSize, buffers);
+            if (dSize != entry.uncompressedSize) {
+                throw std::runtime_error("Frame at offset " +
+                                         std::to_string(entry.compressedOffset) +
+                                         " does not match its index entry");
             }
-            size_t currentSize = buffer.size();
-            buffer.resize(currentSize + 64 * 1024);
-            compFile.read(buffer.data() + currentSize, 64 * 1024);
-            size_t read = compFile.gcount();
-            buffer.resize(currentSize + read);
+            if (checkChecksums && !index->checksumMatches(chunk, dst, dSize)) {
+                throw std::runtime_error("Checksum mismatch in chunk " + std::to_string(chunk));
+            }
+        }));
+    }
 
-            if (read == 0 && buffer.empty()) break;
-        }
+    while (!futures.empty()) {
+        waitFront();
+    }
 
-        if (buffer.empty()) break;
+    return index->totalUncompressed();
+}
 
-        // Check frame size
-        ZL_Report sizeReport =
-            ZL_getCompressedSize(buffer.data() + bufferPos, buffer.size() - bufferPos);
+// Read the next frame off a non-seekable stream into a buffer from `pool`.
+// `carry` holds bytes read past the end of the previous frame. Returns nullopt
+// at the chunk index, whose first bytes are left in `carry`, or at the end of
+// the stream.
+std::optional<tracezl::PooledBuffer> readStreamFrame(std::istream& in, std::string& carry,
+                                                     size_t compProcessed,
+                                                     tracezl::TraceFormat format,
+                                                     tracezl::BufferPool& pool) {
+    tracezl::PooledBuffer frame = pool.acquire(carry.size());
+    std::memcpy(frame.data(), carry.data(), carry.size());
+    carry.clear();
 
-        if (ZL_isError(sizeReport)) {
-            if (compFile.eof()) {
-                throw std::runtime_error(
-                    "Corrupt compressed file or truncated frame header at offset " +
-                    std::to_string(compProcessed));
-            }
-            if (bufferPos > 0) {
-                buffer.erase(buffer.begin(), buffer.begin() + bufferPos);
-                bufferPos = 0;
-            }
-            size_t currentSize = buffer.size();
-            size_t toRead = 1024 * 1024;
-            buffer.resize(currentSize + toRead);
-            compFile.read(buffer.data() + currentSize, toRead);
-            size_t read = compFile.gcount();
-            buffer.resize(currentSize + read);
-            continue;
+    // Grow a small probe until the frame or column group can be sized
+    size_t probe = 64;
+    size_t cSize;
+    while (true) {
+        if (frame.size() < probe) {
+            size_t have = frame.size();
+            frame.resize(probe);
+            in.read(frame.data() + have, probe - have);
+            frame.resize(have + in.gcount());
+        }
+        if (frame.empty() || tracezl::isIndexBlock(frame.data(), frame.size())) {
+            carry.assign(frame.data(), frame.size());
+            return std::nullopt;
         }
 
-        size_t cSize = ZL_RES_value(sizeReport);
+        if (auto sizes = tracezl::probeChunk(frame.data(), frame.size(), format)) {
+            cSize = sizes->compressed;
+            break;
+        }
+        if (frame.size() < probe) {
+            throw std::runtime_error(
+                "Corrupt compressed file or truncated frame header at offset " +
+                std::to_string(compProcessed));
+        }
+        probe *= 4;
+    }
 
-        // Ensure full frame
-        while (buffer.size() - bufferPos < cSize) {
-            if (compFile.eof()) {
-                throw std::runtime_error("Unexpected EOF: Compressed frame requires " +
-                                         std::to_string(cSize) + " bytes.");
-            }
-            if (bufferPos > 0) {
-                buffer.erase(buffer.begin(), buffer.begin() + bufferPos);
-                bufferPos = 0;
-            }
-            size_t needed = cSize - buffer.size();
-            size_t toRead = std::max(needed, size_t(1024 * 1024));
-            size_t currentSize = buffer.size();
-            buffer.resize(currentSize + toRead);
-            compFile.read(buffer.data() + currentSize, toRead);
-            size_t read = compFile.gcount();
-            buffer.resize(currentSize + read);
+    // Keep any over-read bytes for the next frame, or read the rest of this one
+    if (frame.size() > cSize) {
+        carry.assign(frame.data() + cSize, frame.size() - cSize);
+        frame.resize(cSize);
+    } else if (frame.size() < cSize) {
+        size_t have = frame.size();
+        frame.resize(cSize);
+        in.read(frame.data() + have, cSize - have);
+        if ((size_t)in.gcount() != cSize - have) {
+            throw std::runtime_error("Unexpected EOF: Compressed frame requires " +
+                                     std::to_string(cSize) + " bytes.");
         }
+    }
+    return frame;
+}
 
-        // Copy frame data for task
-        std::vector<char> frameData(buffer.begin() + bufferPos, buffer.begin() + bufferPos + cSize);
+// Either end is a pipe: frames are discovered as they arrive and written out
+// in order from the main thread.
+size_t decompressStream(const std::string& compressed_path, const std::string& output_path,
+                        const DecompressOptions& options, std::ostream& log) {
+    tracezl::InputFile input(compressed_path);
+    std::istream& compFile = input.stream();
+    const std::optional<size_t> compFileSize = input.size();
 
-        // Submit task
-        futures.push_back(pool.run([frame = std::move(frameData)]() -> std::string {
-            openzl::DCtx dctx;
-            return dctx.decompressSerial(std::string_view(frame.data(), frame.size()));
-        }));
+    tracezl::OutputFile output(output_path);
+    std::ostream& outFile = output.stream();
 
-        bufferPos += cSize;
-        compProcessed += cSize;
+    // Thread Pool
+    tracezl::BufferPool buffers;
+    openzl::training::ThreadPool pool(options.num_threads);
+    struct DecodedChunk {
+        tracezl::PooledBuffer data;
+        uint64_t checksum;
+    };
+    std::deque<std::future<DecodedChunk>> futures;
+    const size_t max_queue_size =
+        options.max_inflight ? options.max_inflight : options.num_threads * 2;
+
+    // Skip the archive header, which gives the record layout
+    std::string carry(tracezl::kArchiveHeaderSize, '\0');
+    compFile.read(carry.data(), carry.size());
+    carry.resize(compFile.gcount());
+    size_t headerSize;
+    const auto header = tracezl::parseArchiveHeader(carry.data(), carry.size(), &headerSize);
+    if (!header) throw std::runtime_error("Not a tracezl archive: no archive header");
+    const tracezl::TraceFormat format = header->format;
+    const size_t rest = headerSize - carry.size();
+    compFile.ignore(rest);
+    if ((size_t)compFile.gcount() != rest) {
+        throw std::runtime_error("Unexpected EOF in archive header");
+    }
+    carry.clear();
+    size_t compProcessed = headerSize;
+
+    // Projected chunks differ from what was hashed, so only full decodes are checked
+    const bool checkChecksums = options.fields == tracezl::kAllFields;
+    size_t totalDecompressed = 0;
+    // Size and checksum of every chunk written, checked against the index
+    // once the stream reaches it
+    std::vector<std::pair<uint64_t, uint64_t>> written;
+
+    auto writeFront = [&]() {
+        DecodedChunk result = futures.front().get();
+        futures.pop_front();
+        outFile.write(result.data.data(), result.data.size());
+        totalDecompressed += result.data.size();
+        written.emplace_back(result.data.size(), result.checksum);
+    };
+
+    while (auto frame = readStreamFrame(compFile, carry, compProcessed, format, buffers)) {
+        // Flow control
+        if (futures.size() >= max_queue_size) {
+            writeFront();
+        }
+
+        compProcessed += frame->size();
+
+        // Submit task; the frame buffer moves into it without a copy
+        futures.push_back(pool.run([&buffers, frame = std::move(*frame), format,
+                                    fields = options.fields, checkChecksums]() {
+            tracezl::PooledBuffer data =
+                tracezl::decodeChunk(format, fields, frame.data(), frame.size(), buffers);
+            const uint64_t checksum = checkChecksums ? tracezl::xxh64(data.data(), data.size()) : 0;
+            return DecodedChunk{std::move(data), checksum};
+        }));
 
-        std::cout << "\rSubmitted: " << (compProcessed * 100 / compFileSize) << "%" << std::flush;
+        if (compFileSize) {
+            log << "\rSubmitted: " << (compProcessed * 100 / *compFileSize) << "%" << std::flush;
+        } else {
+            log << "\rSubmitted: " << (compProcessed >> 20) << " MB" << std::flush;
+        }
     }
 
     // Drain
     while (!futures.empty()) {
-        std::string result = futures.front().get();
-        futures.pop_front();
-        outFile.write(result.data(), result.size());
-        totalDecompressed += result.size();
+        writeFront();
+    }
+
+    outFile.flush();
+    if (!outFile) throw std::runtime_error("Failed to write output file");
+
+    // The index ends the stream, so its checksums can only be compared after
+    // the chunks are written; a mismatch still fails the run
+    std::string block = std::move(carry);
+    block.append(std::istreambuf_iterator<char>(compFile), std::istreambuf_iterator<char>());
+    if (block.empty()) throw std::runtime_error("Archive ends without its chunk index");
+    const tracezl::ChunkIndex index =
+        tracezl::parseChunkIndex(block.data(), block.size(), compProcessed);
+    if (index.size() != written.size()) {
+        throw std::runtime_error("Chunk index lists " + std::to_string(index.size()) +
+                                 " chunks, the archive holds " + std::to_string(written.size()));
+    }
+    for (size_t chunk = 0; chunk < written.size(); ++chunk) {
+        if (index[chunk].uncompressedSize != written[chunk].first) {
+            throw std::runtime_error("Chunk " + std::to_string(chunk) +
+                                     " does not match its index entry");
+        }
+        if (checkChecksums && index[chunk].checksum != written[chunk].second) {
+            throw std::runtime_error("Checksum mismatch in chunk " + std::to_string(chunk));
+        }
+    }
+    return totalDecompressed;
+}
+
+}  // namespace
+
+void decompress_trace(const std::string& compressed_path, const std::string& output_path,
+                      const DecompressOptions& options) {
+    std::ostream& log = tracezl::logStream(output_path);
+    log << "Decompressing " << compressed_path << " to " << output_path << " with "
+        << options.num_threads << " threads..." << std::endl;
+
+    size_t totalDecompressed;
+    if (tracezl::isRegularFile(compressed_path) && tracezl::isMappableOutput(output_path)) {
+        totalDecompressed = decompressToFile(compressed_path, output_path, options, log);
+    } else {
+        totalDecompressed = decompressStream(compressed_path, output_path, options, log);
     }
 
-    std::cout << std::endl;
-    std::cout << "Decompression complete. Recovered " << totalDecompressed << " bytes."
-              << std::endl;
+    log << std::endl;
+    log << "Decompression complete. Recovered " << totalDecompressed << " bytes." << std::endl;
 }
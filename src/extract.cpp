@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "columnar.h"
+#include "compressor.h"
+#include "container.h"
+#include "io.h"
+#include "tools/training/utils/thread_pool.h"
+
+void extract_trace(const std::string& compressed_path, const std::string& output_path,
+                   uint64_t skip, uint64_t count, size_t num_threads, tracezl::FieldMask fields) {
+    std::ostream& log = tracezl::logStream(output_path);
+    log << "Extracting instructions from " << compressed_path << " to " << output_path << " with "
+        << num_threads << " threads..." << std::endl;
+
+    // Extraction seeks by chunk, so the archive itself cannot be a pipe
+    if (tracezl::isStdio(compressed_path)) {
+        throw std::runtime_error("extract needs a seekable archive, not stdin");
+    }
+    std::ifstream compFile(compressed_path, std::ios::binary | std::ios::ate);
+    if (!compFile) throw std::runtime_error("Cannot open compressed file");
+    size_t compFileSize = compFile.tellg();
+
+    auto index = tracezl::readChunkIndex(compFile, compFileSize);
+    if (!index) {
+        log << "No chunk index found, scanning frames..." << std::endl;
+        index = tracezl::scanChunkIndex(compFile, compFileSize);
+    }
+
+    const uint64_t totalInstrs = index->totalInstrs();
+    if (skip >= totalInstrs || count == 0) {
+        throw std::runtime_error("Requested range is empty: trace holds " +
+                                 std::to_string(totalInstrs) + " instructions");
+    }
+    const uint64_t end = skip + std::min(count, totalInstrs - skip);
+
+    // Only the frames overlapping [skip, end) are read and decoded
+    const size_t firstChunk = index->findChunk(skip);
+    const size_t lastChunk = index->findChunk(end - 1);
+
+    tracezl::OutputFile output(output_path);
+    std::ostream& outFile = output.stream();
+
+    // Thread Pool
+    tracezl::BufferPool buffers;
+    openzl::training::ThreadPool pool(num_threads);
+    std::deque<std::future<tracezl::PooledBuffer>> futures;
+    const size_t max_queue_size = num_threads * 2;
+
+    const size_t instrSize = tracezl::recordSize(index->format());
+    size_t nextWrite = firstChunk;
+    uint64_t totalExtracted = 0;
+
+    // Write the part of the oldest decoded chunk that falls inside the range
+    auto writeFront = [&]() {
+        tracezl::PooledBuffer result = futures.front().get();
+        futures.pop_front();
+
+        const uint64_t chunkFirst = index->firstInstr(nextWrite);
+        const uint64_t from = std::max(skip, chunkFirst) - chunkFirst;
+        const uint64_t to = std::min(end, chunkFirst + (*index)[nextWrite].numInstrs) - chunkFirst;
+        if (to > result.size() / instrSize) {
+            throw std::runtime_error("Chunk " + std::to_string(nextWrite) +
+                                     " is shorter than its index entry");
+        }
+        outFile.write(result.data() + from * instrSize, (to - from) * instrSize);
+        totalExtracted += to - from;
+        ++nextWrite;
+    };
+
+    for (size_t chunk = firstChunk; chunk <= lastChunk; ++chunk) {
+        // Flow control
+        if (futures.size() >= max_queue_size) {
+            writeFront();
+        }
+
+        const tracezl::ChunkIndexEntry& entry = (*index)[chunk];
+        tracezl::PooledBuffer frame = buffers.acquire(entry.compressedSize);
+        compFile.clear();
+        compFile.seekg(entry.compressedOffset);
+        compFile.read(frame.data(), frame.size());
+        if ((size_t)compFile.gcount() != frame.size()) {
+            throw std::runtime_error("Unexpected EOF reading chunk " + std::to_string(chunk));
+        }
+
+        futures.push_back(pool.run([&, frame = std::move(frame), chunk]() {
+            tracezl::PooledBuffer decoded = tracezl::decodeChunk(
+                index->format(), fields, frame.data(), frame.size(), buffers);
+            // Projected chunks differ from what was hashed
+            if (fields == tracezl::kAllFields &&
+                !index->checksumMatches(chunk, decoded.data(), decoded.size())) {
+                throw std::runtime_error("Checksum mismatch in chunk " + std::to_string(chunk));
+            }
+            return decoded;
+        }));
+    }
+
+    // Drain
+    while (!futures.empty()) {
+        writeFront();
+    }
+
+    outFile.flush();
+    if (!outFile) throw std::runtime_error("Failed to write output file");
+
+    log << "Extracted " << totalExtracted << " instructions starting at " << skip << " (decoded "
+        << (lastChunk - firstChunk + 1) << " of " << index->size() << " chunks)." << std::endl;
+}
@@ -0,0 +1,149 @@
+#include "io.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+namespace tracezl {
+
+bool isStdio(const std::string& path) { return path == "-"; }
+
+InputFile::InputFile(const std::string& path) {
+    if (isStdio(path)) {
+        stream_ = &std::cin;
+        return;
+    }
+
+    file_.open(path, std::ios::binary | std::ios::ate);
+    if (!file_) throw std::runtime_error("Cannot open input file " + path);
+    size_ = file_.tellg();
+    file_.seekg(0);
+    stream_ = &file_;
+}
+
+OutputFile::OutputFile(const std::string& path, bool update) {
+    if (isStdio(path)) {
+        stream_ = &std::cout;
+        return;
+    }
+
+    if (update) {
+        file_.open(path, std::ios::binary | std::ios::in | std::ios::out);
+        file_.seekp(0, std::ios::end);
+    } else {
+        file_.open(path, std::ios::binary);
+    }
+    if (!file_) throw std::runtime_error("Cannot open output file " + path);
+    stream_ = &file_;
+}
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open input file " + path + ": " + std::strerror(errno));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot stat input file " + path);
+    }
+    size_ = st.st_size;
+
+    // mmap rejects empty mappings; an empty file is simply an empty view
+    if (size_ > 0) {
+        void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Cannot map input file " + path + ": " +
+                                     std::strerror(errno));
+        }
+        data_ = (const char*)addr;
+        // Chunks are consumed front to back, so favour aggressive read-ahead
+        madvise(addr, size_, MADV_SEQUENTIAL);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_) munmap((void*)data_, size_);
+}
+
+void MappedFile::prefetch(size_t offset, size_t size) const {
+    if (!data_ || offset >= size_) return;
+
+    // madvise needs a page-aligned start
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+    const size_t start = offset / pageSize * pageSize;
+    const size_t end = std::min(offset + size, size_);
+    madvise((void*)(data_ + start), end - start, MADV_WILLNEED);
+}
+
+MappedOutputFile::MappedOutputFile(const std::string& path, size_t size) : size_(size) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open output file " + path + ": " + std::strerror(errno));
+    }
+    if (ftruncate(fd, size_) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot resize output file " + path + ": " +
+                                 std::strerror(errno));
+    }
+
+    if (size_ > 0) {
+        void* addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Cannot map output file " + path + ": " +
+                                     std::strerror(errno));
+        }
+        data_ = (char*)addr;
+    }
+    close(fd);
+}
+
+MappedOutputFile::~MappedOutputFile() {
+    if (data_) munmap(data_, size_);
+}
+
+TempDir::TempDir() {
+    const char* base = std::getenv("TMPDIR");
+    std::string pattern = std::string(base && *base ? base : "/tmp") + "/tracezl.XXXXXX";
+    if (!mkdtemp(pattern.data())) {
+        throw std::runtime_error("Cannot create temporary directory: " +
+                                 std::string(std::strerror(errno)));
+    }
+    path_ = std::move(pattern);
+}
+
+TempDir::~TempDir() {
+    std::error_code ec;
+    std::filesystem::remove_all(path_, ec);
+}
+
+bool isRegularFile(const std::string& path) {
+    struct stat st;
+    return !isStdio(path) && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+bool isMappableOutput(const std::string& path) {
+    if (isStdio(path)) return false;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return errno == ENOENT;
+    return S_ISREG(st.st_mode);
+}
+
+std::ostream& logStream(const std::string& output_path) {
+    return isStdio(output_path) ? std::cerr : std::cout;
+}
+
+}  // namespace tracezl
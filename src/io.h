@@ -0,0 +1,107 @@
+#pragma once
+
+#include <fstream>
+#include <iosfwd>
+#include <optional>
+#include <string>
+
+namespace tracezl {
+
+// A path of "-" selects stdin or stdout
+bool isStdio(const std::string& path);
+
+// Trace or archive input: either a file or stdin
+class InputFile {
+public:
+    explicit InputFile(const std::string& path);
+
+    std::istream& stream() { return *stream_; }
+    // Size in bytes, known only for regular files
+    std::optional<size_t> size() const { return size_; }
+
+private:
+    std::ifstream file_;
+    std::istream* stream_;
+    std::optional<size_t> size_;
+};
+
+// Trace or archive output: either a file or stdout
+class OutputFile {
+public:
+    // With `update`, an existing file is opened without truncating it and
+    // written from its end
+    explicit OutputFile(const std::string& path, bool update = false);
+
+    std::ostream& stream() { return *stream_; }
+    bool isStdout() const { return stream_ != &file_; }
+
+private:
+    std::ofstream file_;
+    std::ostream* stream_;
+};
+
+// Read-only memory mapping of a whole regular file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // Ask the kernel to start reading [offset, offset + size) in the background
+    void prefetch(size_t offset, size_t size) const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Writable shared mapping of an output file created with a known final size,
+// so several threads can fill disjoint ranges of it in place
+class MappedOutputFile {
+public:
+    MappedOutputFile(const std::string& path, size_t size);
+    ~MappedOutputFile();
+
+    MappedOutputFile(const MappedOutputFile&) = delete;
+    MappedOutputFile& operator=(const MappedOutputFile&) = delete;
+
+    char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Private directory under $TMPDIR (or /tmp), removed with its contents on
+// destruction
+class TempDir {
+public:
+    TempDir();
+    ~TempDir();
+
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    const std::string& path() const { return path_; }
+
+private:
+    std::string path_;
+};
+
+// Whether `path` names a regular file that can be memory mapped
+bool isRegularFile(const std::string& path);
+
+// Whether `path` can be written through a MappedOutputFile: a regular file
+// or a path that does not exist yet
+bool isMappableOutput(const std::string& path);
+
+// Progress messages go to stderr when the payload is written to stdout
+std::ostream& logStream(const std::string& output_path);
+
+}  // namespace tracezl
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+namespace tracezl {
+
+// Quote and escape a string for a JSON report
+inline std::string jsonQuote(const std::string& value) {
+    std::string out = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+}  // namespace tracezl
@@ -0,0 +1,109 @@
+#include "levels.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "little_endian.h"
+
+namespace tracezl {
+
+namespace {
+
+constexpr size_t kLevelsHeaderSize = 8;
+constexpr size_t kLevelHeaderSize = 4 * sizeof(uint64_t);
+
+// Ties keep the lower level number
+const ConfigLevel& fastest(const std::vector<ConfigLevel>& levels) {
+    return *std::max_element(levels.begin(), levels.end(), [](const auto& a, const auto& b) {
+        return a.compressMBps() < b.compressMBps();
+    });
+}
+
+const ConfigLevel& bestRatio(const std::vector<ConfigLevel>& levels) {
+    return *std::max_element(levels.begin(), levels.end(),
+                             [](const auto& a, const auto& b) { return a.ratio() < b.ratio(); });
+}
+
+}  // namespace
+
+std::string serializeLevels(const std::vector<ConfigLevel>& levels) {
+    if (levels.empty() || levels.size() > UINT16_MAX) {
+        throw std::runtime_error("A config holds between 1 and 65535 levels");
+    }
+    std::string out(kLevelsHeaderSize, '\0');
+    storeLE32(out.data(), kLevelsMagic);
+    storeLE16(out.data() + 4, kLevelsVersion);
+    storeLE16(out.data() + 6, (uint16_t)levels.size());
+    for (const ConfigLevel& level : levels) {
+        char header[kLevelHeaderSize];
+        storeLE64(header, level.sampleBytes);
+        storeLE64(header + 8, level.compressedBytes);
+        storeLE64(header + 16, level.compressNanos);
+        storeLE64(header + 24, level.config.size());
+        out.append(header, sizeof(header));
+        out += level.config;
+    }
+    return out;
+}
+
+std::vector<ConfigLevel> parseLevels(const std::string& configData) {
+    const char* p = configData.data();
+    if (configData.size() < kLevelsHeaderSize || loadLE32(p) != kLevelsMagic) {
+        return {ConfigLevel{.config = configData}};
+    }
+    if (loadLE16(p + 4) != kLevelsVersion) {
+        throw std::runtime_error("Unsupported config level version " +
+                                 std::to_string(loadLE16(p + 4)));
+    }
+
+    std::vector<ConfigLevel> levels(loadLE16(p + 6));
+    size_t pos = kLevelsHeaderSize;
+    for (ConfigLevel& level : levels) {
+        if (configData.size() - pos < kLevelHeaderSize) {
+            throw std::runtime_error("Truncated config levels");
+        }
+        level.sampleBytes = loadLE64(p + pos);
+        level.compressedBytes = loadLE64(p + pos + 8);
+        level.compressNanos = loadLE64(p + pos + 16);
+        const uint64_t size = loadLE64(p + pos + 24);
+        pos += kLevelHeaderSize;
+        if (configData.size() - pos < size) throw std::runtime_error("Truncated config levels");
+        level.config.assign(p + pos, size);
+        pos += size;
+    }
+    if (levels.empty()) throw std::runtime_error("Config holds no levels");
+    return levels;
+}
+
+const ConfigLevel& selectLevel(const std::vector<ConfigLevel>& levels, const std::string& name) {
+    if (name == "fast") return fastest(levels);
+    if (name == "max") return bestRatio(levels);
+    if (name == "balanced") return levels[(levels.size() - 1) / 2];
+
+    size_t number = 0;
+    size_t parsed = 0;
+    try {
+        number = std::stoul(name, &parsed);
+    } catch (const std::exception&) {
+    }
+    if (parsed == 0 || parsed != name.size()) {
+        throw std::runtime_error("Unknown level '" + name +
+                                 "': expected fast, balanced, max or a level number");
+    }
+    if (number >= levels.size()) {
+        throw std::runtime_error("Level " + name + " does not exist: the config holds " +
+                                 std::to_string(levels.size()) + " levels");
+    }
+    return levels[number];
+}
+
+const ConfigLevel& selectLevel(const std::vector<ConfigLevel>& levels, double mbps) {
+    const ConfigLevel* chosen = nullptr;
+    for (const ConfigLevel& level : levels) {
+        if (level.compressMBps() < mbps) continue;
+        if (!chosen || level.ratio() > chosen->ratio()) chosen = &level;
+    }
+    return chosen ? *chosen : fastest(levels);
+}
+
+}  // namespace tracezl
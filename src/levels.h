@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tracezl {
+
+// One point of the training Pareto frontier, with the cost measured on the
+// training samples when it was saved
+struct ConfigLevel {
+    std::string config;  // serialized compressor
+    uint64_t sampleBytes = 0;
+    uint64_t compressedBytes = 0;
+    uint64_t compressNanos = 0;  // single-threaded compression time
+
+    double ratio() const { return compressedBytes ? (double)sampleBytes / compressedBytes : 0; }
+    double compressMBps() const { return compressNanos ? sampleBytes * 1e3 / compressNanos : 0; }
+};
+
+// A config file holds either one serialized compressor, as written before
+// levels existed, or every frontier point of a training run:
+//
+//   [u32 kLevelsMagic][u16 version][u16 level count]
+//   per level: [u64 sample bytes][u64 compressed bytes][u64 compress ns]
+//              [u64 config size][config bytes]
+//
+// Training stores levels by ratio, lowest first. The order comes from the
+// compressed sizes, which unlike the timings repeat between runs, so a level
+// number names the same point when the same samples are retrained. Nothing
+// else may be assumed about it: the timings are noisy and need not fall as
+// the ratio rises.
+constexpr uint32_t kLevelsMagic = 0x564C5A54;  // "TZLV"
+constexpr uint16_t kLevelsVersion = 1;
+
+std::string serializeLevels(const std::vector<ConfigLevel>& levels);
+// Parse a config file; a plain serialized compressor is a single level
+// without measurements
+std::vector<ConfigLevel> parseLevels(const std::string& configData);
+
+// Pick a level by name: "fast" (the highest measured speed), "max" (the
+// highest ratio), "balanced" (the middle level number) or a level number
+const ConfigLevel& selectLevel(const std::vector<ConfigLevel>& levels, const std::string& name);
+// Pick the highest-ratio level measured at or above `mbps`, or the fastest
+// one if none is
+const ConfigLevel& selectLevel(const std::vector<ConfigLevel>& levels, double mbps);
+
+}  // namespace tracezl
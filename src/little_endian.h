@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+namespace tracezl {
+
+// Fixed-width little-endian fields of the archive format
+
+inline void storeLE64(char* dst, uint64_t value) {
+    for (int i = 0; i < 8; ++i) dst[i] = (char)(value >> (8 * i));
+}
+
+inline void storeLE32(char* dst, uint32_t value) {
+    for (int i = 0; i < 4; ++i) dst[i] = (char)(value >> (8 * i));
+}
+
+inline void storeLE16(char* dst, uint16_t value) {
+    for (int i = 0; i < 2; ++i) dst[i] = (char)(value >> (8 * i));
+}
+
+inline uint64_t loadLE64(const char* src) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) value |= (uint64_t)(uint8_t)src[i] << (8 * i);
+    return value;
+}
+
+inline uint32_t loadLE32(const char* src) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) value |= (uint32_t)(uint8_t)src[i] << (8 * i);
+    return value;
+}
+
+inline uint16_t loadLE16(const char* src) {
+    return (uint16_t)((uint8_t)src[0] | (uint8_t)src[1] << 8);
+}
+
+}  // namespace tracezl
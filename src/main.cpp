@@ -1,7 +1,10 @@
 #include <CLI/CLI.hpp>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "compressor.h"
 
@@ -17,35 +20,124 @@ int main(int argc, char** argv) {
     size_t chunk_size = 100 * 1024 * 1024;  // Default 100MB
     size_t num_threads = std::thread::hardware_concurrency();
     if (num_threads == 0) num_threads = 4;
+    size_t max_inflight = 0;  // Default: twice the thread count
+    size_t max_memory = 0;    // Default: unbounded
+    bool no_mmap = false;
+    bool embed_config = false;
+    bool columnar = false;
+    bool append = false;
+    std::string level = "max";
+    double target_mbps = 0;
+    std::string fields = "all";
+    bool compress_stats = false;
+    std::string stats_json;
+    std::string format_name = "champsim";
+    const auto formatNames = CLI::IsMember({"champsim", "cloudsuite"});
+    const char* const fieldsHelp =
+        "Comma-separated fields to decode, others are zeroed: ip, is_branch, branch_taken, "
+        "dest_regs, src_regs, dest_mem, src_mem, extra (default: all)";
+    const char* const levelHelp = "Config level: fast, balanced, max or a number (default: max)";
+    auto parseFieldList = [](const std::string& list) {
+        return list == "all" ? tracezl::kAllFields : tracezl::parseFields(list);
+    };
 
     // Train command
+    std::vector<std::string> trace_paths;
+    TrainOptions train_options;
     auto train = app.add_subcommand("train", "Train the compressor model");
-    train->add_option("trace_file", trace_path, "Path to the input trace file")->required();
+    train->add_option("trace_files", trace_paths, "Paths to the input trace files")->required();
     train->add_option("output_config", config_path, "Path to save the output configuration")
         ->required();
     train->add_option("-t,--threads", num_threads,
                       "Number of threads to use (default: hardware concurrency)");
+    train->add_option("-f,--format", format_name, "Trace record format (default: champsim)")
+        ->check(formatNames);
+    train->add_option("-s,--chunk-size", chunk_size,
+                      "Size of each training sample; use the compress chunk size (default: 100MB)");
+    train->add_option("--samples", train_options.num_samples,
+                      "Number of chunks sampled across the inputs (default: 16)");
+    train->add_option("--max-memory", train_options.max_memory,
+                      "Cap on sampled bytes, 0 for none (default: 2GB)");
     train->callback([&]() {
         try {
-            train_compressor(trace_path, config_path, num_threads);
+            train_options.num_threads = num_threads;
+            train_options.format = *tracezl::parseFormat(format_name);
+            train_options.chunk_size = chunk_size;
+            train_compressor(trace_paths, config_path, train_options);
         } catch (const std::exception& e) {
             std::cerr << "Error during training: " << e.what() << "\n";
             exit(1);
         }
     });
 
-    // Compress command
+    // Compress command. With --batch the only positional is the config file.
+    std::string batch_list;
+    std::string out_dir;
     auto compress = app.add_subcommand("compress", "Compress a trace file");
-    compress->add_option("trace_file", trace_path, "Path to the input trace file")->required();
-    compress->add_option("output_file", output_path, "Path to save the compressed output")
-        ->required();
-    compress->add_option("config_file", config_path, "Path to the configuration file")->required();
+    compress->add_option("trace_file", trace_path,
+                         "Path to the input trace file ('-' for stdin), optionally xz or gzip");
+    compress->add_option("output_file", output_path,
+                         "Path to save the compressed output ('-' for stdout)");
+    compress->add_option("config_file", config_path, "Path to the configuration file");
+    auto batch_opt = compress->add_option(
+        "--batch", batch_list, "File listing traces to compress, one per line (config_file only)");
+    auto out_dir_opt =
+        compress->add_option("--out-dir", out_dir, "Directory for the archives of --batch");
+    batch_opt->needs(out_dir_opt);
+    out_dir_opt->needs(batch_opt);
     compress->add_option("-s,--chunk-size", chunk_size, "Chunk size in bytes (default: 100MB)");
     compress->add_option("-t,--threads", num_threads,
                          "Number of threads to use (default: hardware concurrency)");
+    compress->add_option("--max-inflight", max_inflight,
+                         "Maximum number of chunks held in memory (default: 2x threads)");
+    compress->add_option("--max-memory", max_memory,
+                         "Memory budget in bytes; picks chunk size and queue depth to fit");
+    compress->add_flag("--no-mmap", no_mmap,
+                       "Read the input with buffered I/O instead of memory mapping it");
+    compress->add_flag("--embed-config", embed_config,
+                       "Store the configuration in the archive header, not only its hash");
+    compress->add_option("-f,--format", format_name,
+                         "Trace record format, as used for training (default: champsim)")
+        ->check(formatNames);
+    auto level_opt = compress->add_option("-l,--level", level, levelHelp);
+    compress->add_option("--target-mbps", target_mbps,
+                         "Pick the best-ratio level that compressed at least this many MB/s "
+                         "per thread in training")
+        ->excludes(level_opt);
+    compress->add_flag("--columnar", columnar,
+                       "Store each field in its own frame so --fields can skip the others");
+    compress->add_flag("--append", append,
+                       "Add the trace to the end of output_file, an archive of the same config");
+    compress->add_flag("--stats", compress_stats,
+                       "Print per-field sizes and per-stage times at the end");
+    compress->add_option("--stats-json", stats_json,
+                         "Write per-field sizes and per-stage times as JSON ('-' for stdout)");
     compress->callback([&]() {
         try {
-            compress_trace(trace_path, output_path, config_path, chunk_size, num_threads);
+            CompressOptions options = {.level = level,
+                                       .target_mbps = target_mbps,
+                                       .chunk_size = chunk_size,
+                                       .num_threads = num_threads,
+                                       .max_inflight = max_inflight,
+                                       .max_memory = max_memory,
+                                       .use_mmap = !no_mmap,
+                                       .format = *tracezl::parseFormat(format_name),
+                                       .embed_config = embed_config,
+                                       .columnar = columnar,
+                                       .append = append,
+                                       .stats = compress_stats,
+                                       .stats_json = stats_json};
+            if (!batch_list.empty()) {
+                if (trace_path.empty() || !output_path.empty()) {
+                    throw std::runtime_error("--batch takes the config file as its only argument");
+                }
+                compress_batch(batch_list, out_dir, trace_path, options);
+            } else {
+                if (config_path.empty()) {
+                    throw std::runtime_error("expected trace_file output_file config_file");
+                }
+                compress_trace(trace_path, output_path, config_path, options);
+            }
         } catch (const std::exception& e) {
             std::cerr << "Error during compression: " << e.what() << "\n";
             exit(1);
@@ -54,24 +146,121 @@ int main(int argc, char** argv) {
 
     // Decompress command
     auto decompress = app.add_subcommand("decompress", "Decompress a trace file");
-    decompress->add_option("compressed_file", compressed_path, "Path to the compressed input file")
-        ->required();
-    decompress->add_option("output_file", output_path, "Path to save the decompressed trace")
+    decompress->add_option("compressed_file", compressed_path,
+                           "Path to the compressed input file ('-' for stdin)")
         ->required();
-    decompress->add_option("config_file", config_path, "Path to the configuration file")
+    decompress->add_option("output_file", output_path,
+                           "Path to save the decompressed trace ('-' for stdout)")
         ->required();
-    decompress->add_option("-s,--chunk-size", chunk_size, "Chunk size in bytes (default: 100MB)");
     decompress->add_option("-t,--threads", num_threads,
                            "Number of threads to use (default: hardware concurrency)");
+    decompress->add_option("--max-inflight", max_inflight,
+                           "Maximum number of frames held in memory (default: 2x threads)");
+    decompress->add_option("--fields", fields, fieldsHelp);
     decompress->callback([&]() {
         try {
-            decompress_trace(compressed_path, output_path, config_path, chunk_size, num_threads);
+            DecompressOptions options = {.num_threads = num_threads,
+                                         .max_inflight = max_inflight,
+                                         .fields = parseFieldList(fields)};
+            decompress_trace(compressed_path, output_path, options);
         } catch (const std::exception& e) {
             std::cerr << "Error during decompression: " << e.what() << "\n";
             exit(1);
         }
     });
 
+    // Extract command
+    uint64_t skip = 0;
+    uint64_t count = std::numeric_limits<uint64_t>::max();
+    auto extract =
+        app.add_subcommand("extract", "Decompress a range of instructions from a trace file");
+    extract->add_option("compressed_file", compressed_path, "Path to the compressed input file")
+        ->required();
+    extract->add_option("output_file", output_path,
+                        "Path to save the extracted trace ('-' for stdout)")
+        ->required();
+    extract->add_option("--skip", skip, "Number of instructions to skip (default: 0)");
+    extract->add_option("--count", count,
+                        "Number of instructions to extract (default: until end of trace)");
+    extract->add_option("-t,--threads", num_threads,
+                        "Number of threads to use (default: hardware concurrency)");
+    extract->add_option("--fields", fields, fieldsHelp);
+    extract->callback([&]() {
+        try {
+            extract_trace(compressed_path, output_path, skip, count, num_threads,
+                          parseFieldList(fields));
+        } catch (const std::exception& e) {
+            std::cerr << "Error during extraction: " << e.what() << "\n";
+            exit(1);
+        }
+    });
+
+    // Verify command
+    auto verify =
+        app.add_subcommand("verify", "Check that every chunk of a trace file decodes intact");
+    verify->add_option("compressed_file", compressed_path, "Path to the compressed input file")
+        ->required();
+    verify->add_option("-t,--threads", num_threads,
+                       "Number of threads to use (default: hardware concurrency)");
+    verify->callback([&]() {
+        try {
+            verify_archive(compressed_path, num_threads);
+        } catch (const std::exception& e) {
+            std::cerr << "Error during verification: " << e.what() << "\n";
+            exit(1);
+        }
+    });
+
+    // Stats command
+    SummaryOptions summary_options;
+    auto stats = app.add_subcommand(
+        "stats", "Print branch, footprint, memory and register statistics of a trace file");
+    stats->add_option("compressed_file", compressed_path, "Path to the compressed input file")
+        ->required();
+    stats->add_option("-t,--threads", num_threads,
+                      "Number of threads to use (default: hardware concurrency)");
+    stats->add_flag("--json", summary_options.json, "Print a JSON object on stdout");
+    stats->callback([&]() {
+        try {
+            summary_options.num_threads = num_threads;
+            summarize_trace(compressed_path, summary_options);
+        } catch (const std::exception& e) {
+            std::cerr << "Error during stats: " << e.what() << "\n";
+            exit(1);
+        }
+    });
+
+    // Bench command
+    BenchOptions bench_options;
+    if (num_threads > 1) bench_options.thread_counts.push_back(num_threads);
+    auto bench = app.add_subcommand("bench", "Measure in-memory compression and decompression");
+    bench->add_option("trace_file", trace_path, "Path to the input trace file")->required();
+    bench->add_option("config_file", config_path, "Path to the configuration file")->required();
+    bench->add_option("-s,--chunk-size", bench_options.chunk_sizes,
+                      "Comma-separated chunk sizes in bytes to sweep (default: 100MB)")
+        ->delimiter(',');
+    bench->add_option("-t,--threads", bench_options.thread_counts,
+                      "Comma-separated thread counts to sweep (default: 1 and all cores)")
+        ->delimiter(',');
+    bench->add_option("--repeat", bench_options.repeat,
+                      "Timed runs per sweep point, best is reported (default: 3)");
+    bench->add_option("-f,--format", format_name, "Trace record format (default: champsim)")
+        ->check(formatNames);
+    bench->add_option("-l,--level", bench_options.level, levelHelp);
+    bench->add_flag("--kernels", bench_options.kernels,
+                    "Also time splitting records into field streams and back at each SIMD "
+                    "level, on one thread");
+    bench->add_flag("--json", bench_options.json, "Print a JSON report on stdout");
+    bench->callback([&]() {
+        try {
+            bench_options.format = *tracezl::parseFormat(format_name);
+            bench_trace(trace_path, config_path, bench_options);
+        } catch (const std::exception& e) {
+            std::cerr << "Error during benchmark: " << e.what() << "\n";
+            exit(1);
+        }
+    });
+
     CLI11_PARSE(app, argc, argv);
 
     return 0;
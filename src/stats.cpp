@@ -0,0 +1,149 @@
+#include "stats.h"
+
+#include <time.h>
+
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+#include "json.h"
+#include "trace_codec.h"
+
+namespace tracezl {
+
+namespace {
+
+double clockSeconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Rows of the stage breakdown: ACE graphs are reported apart from the split
+struct StageRow {
+    const char* name;
+    StageTime time;
+};
+
+std::array<StageRow, NUM_STAGES + 1> stageRows(const CompressStats& stats) {
+    const StageTime& split = stats.stages[STAGE_SPLIT];
+    const StageTime& codec = stats.stages[STAGE_CODEC];
+    return {{{"read", stats.stages[STAGE_READ]},
+             {"split", split},
+             {"ace", {codec.wall - split.wall, codec.cpu - split.cpu}},
+             {"write", stats.stages[STAGE_WRITE]},
+             {"codec_total", codec}}};
+}
+
+}  // namespace
+
+void CompressStats::merge(const CompressStats& other) {
+    for (size_t i = 0; i < MAX_TAGS; ++i) {
+        fieldBytes[i] += other.fieldBytes[i];
+        fieldCompressed[i] += other.fieldCompressed[i];
+    }
+    for (size_t i = 0; i < NUM_STAGES; ++i) {
+        stages[i].wall += other.stages[i].wall;
+        stages[i].cpu += other.stages[i].cpu;
+    }
+}
+
+CompressStats*& threadStats() {
+    thread_local CompressStats* stats = nullptr;
+    return stats;
+}
+
+StageTimer::StageTimer(CompressStats* stats) : stats_(stats) {
+    if (!stats_) return;
+    wall_ = clockSeconds(CLOCK_MONOTONIC);
+    cpu_ = clockSeconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void StageTimer::stop(Stage stage) {
+    if (!stats_) return;
+    const double wall = clockSeconds(CLOCK_MONOTONIC);
+    const double cpu = clockSeconds(CLOCK_THREAD_CPUTIME_ID);
+    stats_->stages[stage].wall += wall - wall_;
+    stats_->stages[stage].cpu += cpu - cpu_;
+    wall_ = wall;
+    cpu_ = cpu;
+}
+
+void printStats(std::ostream& out, const CompressStats& stats, TraceFormat format, bool columnar,
+                uint64_t inputBytes, uint64_t compressedBytes, double elapsed) {
+    const size_t numStreams = fieldSplitStreams(format);
+    uint64_t totalRaw = 0, totalField = 0;
+    for (size_t i = 0; i < numStreams; ++i) {
+        totalRaw += stats.fieldBytes[i];
+        totalField += stats.fieldCompressed[i];
+    }
+
+    out << std::fixed << std::setprecision(2);
+    if (columnar) {
+        out << "Fields (column frames; archive total " << compressedBytes
+            << " bytes):" << std::endl;
+        out << std::left << std::setw(14) << "  field" << std::right << std::setw(14) << "raw"
+            << std::setw(14) << "compressed" << std::setw(9) << "ratio" << std::setw(9)
+            << "share" << std::endl;
+    } else {
+        out << "Fields (raw sizes; --columnar also gives compressed ones; archive total "
+            << compressedBytes << " bytes):" << std::endl;
+        out << std::left << std::setw(14) << "  field" << std::right << std::setw(14) << "raw"
+            << std::setw(9) << "share" << std::endl;
+    }
+    for (size_t i = 0; i < numStreams; ++i) {
+        const uint64_t raw = stats.fieldBytes[i];
+        const uint64_t packed = stats.fieldCompressed[i];
+        out << std::left << "  " << std::setw(12) << kFieldNames[i] << std::right
+            << std::setw(14) << raw;
+        if (columnar) {
+            out << std::setw(14) << packed << std::setw(9) << (packed ? (double)raw / packed : 0.0)
+                << std::setw(8) << (totalField ? 100.0 * packed / totalField : 0.0) << "%"
+                << std::endl;
+        } else {
+            out << std::setw(8) << (totalRaw ? 100.0 * raw / totalRaw : 0.0) << "%" << std::endl;
+        }
+    }
+
+    out << "Stages (seconds summed over threads; " << elapsed << " s elapsed, "
+        << inputBytes / 1e6 / elapsed << " MB/s):" << std::endl;
+    out << std::left << std::setw(14) << "  stage" << std::right << std::setw(10) << "wall"
+        << std::setw(10) << "cpu" << std::endl;
+    for (const StageRow& row : stageRows(stats)) {
+        out << std::left << "  " << std::setw(12) << row.name << std::right << std::setw(10)
+            << row.time.wall << std::setw(10) << row.time.cpu << std::endl;
+    }
+}
+
+void printStatsJson(std::ostream& out, const CompressStats& stats, TraceFormat format,
+                    bool columnar, uint64_t inputBytes, uint64_t compressedBytes,
+                    double elapsed) {
+    out << "{\n"
+        << "  \"format\": \"" << formatName(format) << "\",\n"
+        << "  \"input_bytes\": " << inputBytes << ",\n"
+        << "  \"compressed_bytes\": " << compressedBytes << ",\n"
+        << "  \"elapsed_seconds\": " << elapsed << ",\n"
+        << "  \"fields\": {";
+    const size_t numStreams = fieldSplitStreams(format);
+    for (size_t i = 0; i < numStreams; ++i) {
+        out << (i ? "," : "") << "\n    " << jsonQuote(kFieldNames[i])
+            << ": {\"raw_bytes\": " << stats.fieldBytes[i] << ", \"compressed_bytes\": ";
+        if (columnar) {
+            out << stats.fieldCompressed[i];
+        } else {
+            out << "null";
+        }
+        out << "}";
+    }
+    out << "\n  },\n  \"stages\": {";
+    bool first = true;
+    for (const StageRow& row : stageRows(stats)) {
+        out << (first ? "" : ",") << "\n    " << jsonQuote(row.name)
+            << ": {\"wall_seconds\": " << row.time.wall << ", \"cpu_seconds\": " << row.time.cpu
+            << "}";
+        first = false;
+    }
+    out << "\n  }\n}" << std::endl;
+}
+
+}  // namespace tracezl
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+
+#include "trace_format.h"
+
+namespace tracezl {
+
+// Stages of compress_trace. Read and write run on the main thread; split and
+// codec run on the workers, and codec covers the whole OpenZL call, so the
+// ACE graphs account for codec minus split.
+enum Stage { STAGE_READ = 0, STAGE_SPLIT, STAGE_CODEC, STAGE_WRITE, NUM_STAGES };
+
+struct StageTime {
+    double wall = 0;  // seconds, summed over threads
+    double cpu = 0;   // thread CPU seconds, summed over threads
+};
+
+// Breakdown collected by compress --stats. Each chunk task fills its own
+// instance and the main thread merges them, so workers never share one.
+struct CompressStats {
+    // Field stream bytes after splitting and modelling
+    std::array<uint64_t, MAX_TAGS> fieldBytes{};
+    // Column frame bytes of each stream, in columnar archives only: a row
+    // frame compresses all streams in one graph
+    std::array<uint64_t, MAX_TAGS> fieldCompressed{};
+    std::array<StageTime, NUM_STAGES> stages{};
+
+    void merge(const CompressStats& other);
+};
+
+// Stats of the chunk the calling thread is compressing, or null when stats
+// are off. The field splitter reports into it from inside the graph.
+CompressStats*& threadStats();
+
+// Points threadStats() at `stats` for the current scope
+class ThreadStatsScope {
+public:
+    explicit ThreadStatsScope(CompressStats* stats) { threadStats() = stats; }
+    ~ThreadStatsScope() { threadStats() = nullptr; }
+
+    ThreadStatsScope(const ThreadStatsScope&) = delete;
+    ThreadStatsScope& operator=(const ThreadStatsScope&) = delete;
+};
+
+// Adds the wall and thread CPU time between construction (or the previous
+// stop) and stop() to a stage. A no-op without stats, so hot paths pay one
+// branch when stats are off.
+class StageTimer {
+public:
+    explicit StageTimer(CompressStats* stats);
+    void stop(Stage stage);
+
+private:
+    CompressStats* stats_;
+    double wall_ = 0;
+    double cpu_ = 0;
+};
+
+// Print the breakdown as a table or as a JSON object. Compressed field sizes
+// are only shown for `columnar` archives, which have them.
+void printStats(std::ostream& out, const CompressStats& stats, TraceFormat format, bool columnar,
+                uint64_t inputBytes, uint64_t compressedBytes, double elapsed);
+void printStatsJson(std::ostream& out, const CompressStats& stats, TraceFormat format,
+                    bool columnar, uint64_t inputBytes, uint64_t compressedBytes,
+                    double elapsed);
+
+}  // namespace tracezl
@@ -0,0 +1,487 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "columnar.h"
+#include "compressor.h"
+#include "container.h"
+#include "io.h"
+#include "json.h"
+#include "transpose.h"
+#include "tools/training/utils/thread_pool.h"
+
+namespace {
+
+// Set of 64-bit keys with open addressing and linear probing. Zero marks an
+// empty slot, so a zero key is tracked apart.
+class KeySet {
+public:
+    void insert(uint64_t key) {
+        if (key == 0) {
+            hasZero_ = true;
+            return;
+        }
+        if ((size_ + 1) * 2 > slots_.size()) grow();
+        size_t i = slot(key);
+        while (slots_[i] != 0 && slots_[i] != key) i = (i + 1) & mask_;
+        if (slots_[i] == 0) {
+            slots_[i] = key;
+            ++size_;
+        }
+    }
+
+    void merge(const KeySet& other) {
+        hasZero_ |= other.hasZero_;
+        for (uint64_t key : other.slots_) {
+            if (key != 0) insert(key);
+        }
+    }
+
+    uint64_t size() const { return size_ + hasZero_; }
+
+private:
+    // Fibonacci hashing: the high bits of the product index the table
+    size_t slot(uint64_t key) const { return (key * 0x9E3779B97F4A7C15ull) >> shift_; }
+
+    void grow() {
+        std::vector<uint64_t> old(std::max<size_t>(slots_.size() * 2, 1024));
+        old.swap(slots_);
+        mask_ = slots_.size() - 1;
+        shift_ = 64 - __builtin_ctzll(slots_.size());
+        size_ = 0;
+        for (uint64_t key : old) {
+            if (key != 0) insert(key);
+        }
+    }
+
+    std::vector<uint64_t> slots_;
+    size_t mask_ = 0;
+    int shift_ = 64;
+    uint64_t size_ = 0;
+    bool hasZero_ = false;
+};
+
+// Trace characteristics gathered by `tracezl stats`
+struct TraceSummary {
+    uint64_t instrs = 0;
+    uint64_t branches = 0;
+    uint64_t taken = 0;
+    // Instructions with at least one source / destination memory operand
+    uint64_t loads = 0;
+    uint64_t stores = 0;
+    // Non-zero memory operands
+    uint64_t loadOps = 0;
+    uint64_t storeOps = 0;
+    // Uses of each register number; register 0 is an empty slot
+    std::array<uint64_t, 256> destRegs{};
+    std::array<uint64_t, 256> sourceRegs{};
+
+    KeySet ips;
+    KeySet lines;  // 64 B cache lines touched
+    KeySet pages;  // 4 KB pages touched
+
+    // Fold in everything but the key sets, which are merged separately
+    void mergeCounts(const TraceSummary& other) {
+        instrs += other.instrs;
+        branches += other.branches;
+        taken += other.taken;
+        loads += other.loads;
+        stores += other.stores;
+        loadOps += other.loadOps;
+        storeOps += other.storeOps;
+        for (size_t r = 0; r < 256; ++r) {
+            destRegs[r] += other.destRegs[r];
+            sourceRegs[r] += other.sourceRegs[r];
+        }
+    }
+};
+
+// Per-thread partial results. A chunk task borrows a free partial for its
+// duration, so there are at most as many as workers and no task shares one.
+class PartialPool {
+public:
+    TraceSummary* acquire() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.empty()) {
+            all_.push_back(std::make_unique<TraceSummary>());
+            return all_.back().get();
+        }
+        TraceSummary* partial = free_.back();
+        free_.pop_back();
+        return partial;
+    }
+
+    void release(TraceSummary* partial) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(partial);
+    }
+
+    // Only valid once every task is done
+    std::vector<std::unique_ptr<TraceSummary>>& all() { return all_; }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<TraceSummary>> all_;
+    std::vector<TraceSummary*> free_;
+};
+
+// Field columns of one chunk. Registers and memory operands list occupied
+// slots only, as the field splitter's streams do; register 0 and address 0
+// are empty slots and never appear.
+struct ChunkColumns {
+    size_t numInstrs;
+    const uint64_t* ips;
+    const uint8_t* isBranch;
+    const uint8_t* taken;
+    const uint16_t* occupancy;
+    const uint8_t* destRegs;
+    size_t numDestRegs;
+    const uint8_t* srcRegs;
+    size_t numSrcRegs;
+    const uint64_t* destMem;
+    size_t numDestMem;
+    const uint64_t* srcMem;
+    size_t numSrcMem;
+};
+
+// Record the line and page of each address, skipping repeats of the previous
+// one, which are common in loops over arrays and on the stack
+void addAddresses(const uint64_t* addrs, size_t count, TraceSummary& out, uint64_t& lastLine,
+                  uint64_t& lastPage) {
+    for (size_t j = 0; j < count; ++j) {
+        const uint64_t line = addrs[j] >> 6;
+        const uint64_t page = addrs[j] >> 12;
+        if (line != lastLine) {
+            out.lines.insert(line);
+            lastLine = line;
+        }
+        if (page != lastPage) {
+            out.pages.insert(page);
+            lastPage = page;
+        }
+    }
+}
+
+// Set bits of a slot mask of at most 8 bits, in shifts and adds the
+// vectorizer handles where a popcount instruction may not exist
+inline unsigned bitCount(unsigned x) {
+    x = x - (x >> 1 & 0x55);
+    x = (x & 0x33) + (x >> 2 & 0x33);
+    return (x + (x >> 4)) & 0x0f;
+}
+
+// Accumulate one chunk. The branch and operand counts read contiguous
+// columns with no branches on the data, which GCC vectorizes at -O3. The
+// register histograms and the key sets are scatters and stay scalar.
+template <class Format>
+void summarizeColumns(const ChunkColumns& c, TraceSummary& out) {
+    using Transpose = tracezl::RecordTranspose<Format>;
+
+    uint64_t branches = 0;
+    uint64_t takenBranches = 0;
+    for (size_t i = 0; i < c.numInstrs; ++i) {
+        const uint64_t branch = c.isBranch[i] != 0;
+        branches += branch;
+        takenBranches += branch & (c.taken[i] != 0);
+    }
+    out.branches += branches;
+    out.taken += takenBranches;
+
+    constexpr unsigned kSourceMask = (1u << Transpose::kSource) - 1;
+    constexpr unsigned kDestMask = (1u << Transpose::kDest) - 1;
+    uint64_t loads = 0, stores = 0, loadOps = 0, storeOps = 0;
+    for (size_t i = 0; i < c.numInstrs; ++i) {
+        const unsigned occ = c.occupancy[i];
+        const unsigned sources = bitCount(occ >> Transpose::kOccSourceMem & kSourceMask);
+        const unsigned dests = bitCount(occ >> Transpose::kOccDestMem & kDestMask);
+        loads += sources != 0;
+        stores += dests != 0;
+        loadOps += sources;
+        storeOps += dests;
+    }
+    out.loads += loads;
+    out.stores += stores;
+    out.loadOps += loadOps;
+    out.storeOps += storeOps;
+
+    for (size_t j = 0; j < c.numDestRegs; ++j) ++out.destRegs[c.destRegs[j]];
+    for (size_t j = 0; j < c.numSrcRegs; ++j) ++out.sourceRegs[c.srcRegs[j]];
+
+    uint64_t lastIp = 0;
+    for (size_t i = 0; i < c.numInstrs; ++i) {
+        if (c.ips[i] != lastIp || i == 0) out.ips.insert(c.ips[i]);
+        lastIp = c.ips[i];
+    }
+    // The key sets do not depend on the order addresses are added in
+    uint64_t lastLine = ~0ull;
+    uint64_t lastPage = ~0ull;
+    addAddresses(c.srcMem, c.numSrcMem, out, lastLine, lastPage);
+    addAddresses(c.destMem, c.numDestMem, out, lastLine, lastPage);
+    out.instrs += c.numInstrs;
+}
+
+// Accumulate the decoded streams of a column group. Only the models are
+// undone, in place; no records are rebuilt.
+template <class Format>
+void summarizeStreams(tracezl::ColumnStreams& streams, tracezl::FieldMask fields,
+                      TraceSummary& out) {
+    uint64_t* const ips = (uint64_t*)streams.data[tracezl::TAG_IP].data();
+    uint64_t* const destMem = (uint64_t*)streams.data[tracezl::TAG_DEST_MEM].data();
+    uint64_t* const srcMem = (uint64_t*)streams.data[tracezl::TAG_SOURCE_MEM].data();
+    tracezl::unmodelFields(Format::kFormat, streams.views, streams.numInstrs, streams.modelFlags,
+                           fields, ips, destMem, srcMem);
+
+    const tracezl::StreamView* v = streams.views;
+    summarizeColumns<Format>(
+        {.numInstrs = streams.numInstrs,
+         .ips = ips,
+         .isBranch = (const uint8_t*)v[tracezl::TAG_IS_BRANCH].data,
+         .taken = (const uint8_t*)v[tracezl::TAG_BRANCH_TAKEN].data,
+         .occupancy = (const uint16_t*)v[tracezl::TAG_OCCUPANCY].data,
+         .destRegs = (const uint8_t*)v[tracezl::TAG_DEST_REGS].data,
+         .numDestRegs = v[tracezl::TAG_DEST_REGS].numElts,
+         .srcRegs = (const uint8_t*)v[tracezl::TAG_SOURCE_REGS].data,
+         .numSrcRegs = v[tracezl::TAG_SOURCE_REGS].numElts,
+         .destMem = destMem,
+         .numDestMem = v[tracezl::TAG_DEST_MEM].numElts,
+         .srcMem = srcMem,
+         .numSrcMem = v[tracezl::TAG_SOURCE_MEM].numElts},
+        out);
+}
+
+// Accumulate the records of a row chunk, which only decodes whole. They are
+// gathered into columns by the field splitter's SIMD transpose kernels, and
+// the occupied memory slots are packed after them.
+template <class Format>
+void summarizeRecords(const typename Format::Record* records, size_t numInstrs,
+                      TraceSummary& out, tracezl::BufferPool& pool) {
+    using Transpose = tracezl::RecordTranspose<Format>;
+    tracezl::PooledBuffer ips = pool.acquire(numInstrs * sizeof(uint64_t));
+    tracezl::PooledBuffer isBranch = pool.acquire(numInstrs);
+    tracezl::PooledBuffer taken = pool.acquire(numInstrs);
+    tracezl::PooledBuffer occupancy = pool.acquire(numInstrs * sizeof(uint16_t));
+    tracezl::PooledBuffer destRegs = pool.acquire(numInstrs * Transpose::kDest);
+    tracezl::PooledBuffer srcRegs = pool.acquire(numInstrs * Transpose::kSource);
+    tracezl::PooledBuffer destMem = pool.acquire(numInstrs * Transpose::kDest * sizeof(uint64_t));
+    tracezl::PooledBuffer srcMem = pool.acquire(numInstrs * Transpose::kSource * sizeof(uint64_t));
+    const tracezl::GatherColumns columns = {.ips = (uint64_t*)ips.data(),
+                                            .isBranch = (uint8_t*)isBranch.data(),
+                                            .taken = (uint8_t*)taken.data(),
+                                            .occupancy = (uint16_t*)occupancy.data(),
+                                            .destRegs = (uint8_t*)destRegs.data(),
+                                            .srcRegs = (uint8_t*)srcRegs.data()};
+    const tracezl::RegCounts regs = Transpose::gather(
+        tracezl::simdLevel(), reinterpret_cast<const uint8_t*>(records), numInstrs, columns);
+
+    uint64_t* const dests = (uint64_t*)destMem.data();
+    uint64_t* const sources = (uint64_t*)srcMem.data();
+    size_t numDests = 0, numSources = 0;
+    for (size_t i = 0; i < numInstrs; ++i) {
+        const unsigned occ = columns.occupancy[i];
+        for (unsigned s = 0; s < Transpose::kDest; ++s) {
+            if (occ >> (Transpose::kOccDestMem + s) & 1) {
+                dests[numDests++] = records[i].destination_memory[s];
+            }
+        }
+        for (unsigned s = 0; s < Transpose::kSource; ++s) {
+            if (occ >> (Transpose::kOccSourceMem + s) & 1) {
+                sources[numSources++] = records[i].source_memory[s];
+            }
+        }
+    }
+
+    summarizeColumns<Format>({.numInstrs = numInstrs,
+                              .ips = columns.ips,
+                              .isBranch = columns.isBranch,
+                              .taken = columns.taken,
+                              .occupancy = columns.occupancy,
+                              .destRegs = columns.destRegs,
+                              .numDestRegs = regs.dest,
+                              .srcRegs = columns.srcRegs,
+                              .numSrcRegs = regs.source,
+                              .destMem = dests,
+                              .numDestMem = numDests,
+                              .srcMem = sources,
+                              .numSrcMem = numSources},
+                             out);
+}
+
+double ratio(uint64_t part, uint64_t whole) { return whole ? (double)part / whole : 0.0; }
+
+void printSummary(std::ostream& out, const TraceSummary& s) {
+    out << std::fixed << std::setprecision(4);
+    out << "Instructions:        " << s.instrs << std::endl;
+    out << "Branches:            " << s.branches << " (" << ratio(s.branches, s.instrs)
+        << " of instructions)" << std::endl;
+    out << "Taken:               " << s.taken << " (" << ratio(s.taken, s.branches)
+        << " of branches)" << std::endl;
+    out << "Unique IPs:          " << s.ips.size() << std::endl;
+    out << "Footprint (64 B):    " << s.lines.size() << " lines, "
+        << ((s.lines.size() * 64) >> 10) << " KB" << std::endl;
+    out << "Footprint (4 KB):    " << s.pages.size() << " pages, "
+        << ((s.pages.size() * 4096) >> 20) << " MB" << std::endl;
+    out << "Loads:               " << s.loads << " instructions (" << ratio(s.loads, s.instrs)
+        << "), " << s.loadOps << " operands" << std::endl;
+    out << "Stores:              " << s.stores << " instructions (" << ratio(s.stores, s.instrs)
+        << "), " << s.storeOps << " operands" << std::endl;
+
+    out << "Registers (uses as destination / source):" << std::endl;
+    out << std::left << std::setw(8) << "  reg" << std::right << std::setw(14) << "dest"
+        << std::setw(14) << "source" << std::endl;
+    for (size_t r = 1; r < 256; ++r) {
+        if (s.destRegs[r] == 0 && s.sourceRegs[r] == 0) continue;
+        out << std::left << "  " << std::setw(6) << r << std::right << std::setw(14)
+            << s.destRegs[r] << std::setw(14) << s.sourceRegs[r] << std::endl;
+    }
+}
+
+void printSummaryJson(std::ostream& out, const std::string& path, tracezl::TraceFormat format,
+                      const TraceSummary& s) {
+    auto histogram = [&](const std::array<uint64_t, 256>& counts) {
+        out << "{";
+        bool first = true;
+        for (size_t r = 1; r < 256; ++r) {
+            if (counts[r] == 0) continue;
+            out << (first ? "" : ", ") << "\"" << r << "\": " << counts[r];
+            first = false;
+        }
+        out << "}";
+    };
+
+    out << "{\n"
+        << "  \"trace\": " << tracezl::jsonQuote(path) << ",\n"
+        << "  \"format\": \"" << tracezl::formatName(format) << "\",\n"
+        << "  \"instructions\": " << s.instrs << ",\n"
+        << "  \"branches\": " << s.branches << ",\n"
+        << "  \"taken\": " << s.taken << ",\n"
+        << "  \"branch_ratio\": " << ratio(s.branches, s.instrs) << ",\n"
+        << "  \"taken_ratio\": " << ratio(s.taken, s.branches) << ",\n"
+        << "  \"unique_ips\": " << s.ips.size() << ",\n"
+        << "  \"footprint_lines_64b\": " << s.lines.size() << ",\n"
+        << "  \"footprint_pages_4kb\": " << s.pages.size() << ",\n"
+        << "  \"loads\": " << s.loads << ",\n"
+        << "  \"stores\": " << s.stores << ",\n"
+        << "  \"load_operands\": " << s.loadOps << ",\n"
+        << "  \"store_operands\": " << s.storeOps << ",\n"
+        << "  \"dest_registers\": ";
+    histogram(s.destRegs);
+    out << ",\n  \"source_registers\": ";
+    histogram(s.sourceRegs);
+    out << "\n}" << std::endl;
+}
+
+}  // namespace
+
+void summarize_trace(const std::string& compressed_path, const SummaryOptions& options) {
+    std::ostream& log = std::cerr;
+    log << "Summarizing " << compressed_path << " with " << options.num_threads << " threads..."
+        << std::endl;
+    const auto start = std::chrono::steady_clock::now();
+
+    // Chunks are decoded straight out of a mapping, so the archive must be a file
+    if (!tracezl::isRegularFile(compressed_path)) {
+        throw std::runtime_error("stats needs an archive file, not a pipe");
+    }
+    std::ifstream compFile(compressed_path, std::ios::binary | std::ios::ate);
+    if (!compFile) throw std::runtime_error("Cannot open compressed file");
+    size_t compFileSize = compFile.tellg();
+
+    auto index = tracezl::readChunkIndex(compFile, compFileSize);
+    if (!index) {
+        log << "No chunk index found, scanning frames..." << std::endl;
+        index = tracezl::scanChunkIndex(compFile, compFileSize);
+    }
+    const tracezl::TraceFormat format = index->format();
+    const size_t instrSize = tracezl::recordSize(format);
+
+    tracezl::MappedFile input(compressed_path);
+
+    // Thread Pool
+    tracezl::BufferPool buffers;
+    PartialPool partials;
+    openzl::training::ThreadPool pool(options.num_threads);
+    std::vector<std::future<void>> futures;
+    futures.reserve(index->size());
+
+    // Nothing reads the extra bytes, so columnar archives skip that stream
+    const tracezl::FieldMask fields = tracezl::kAllFields & ~tracezl::fieldBit(tracezl::TAG_EXTRA);
+
+    for (const tracezl::ChunkIndexEntry& entry : index->entries()) {
+        if (entry.compressedSize > input.size() ||
+            entry.compressedOffset > input.size() - entry.compressedSize) {
+            throw std::runtime_error("Corrupt chunk index: chunk ends past the archive");
+        }
+        const char* src = input.data() + entry.compressedOffset;
+        futures.push_back(pool.run([&, src, entry]() {
+            // Column groups are counted on their streams, row chunks on records
+            std::optional<tracezl::ColumnStreams> streams =
+                tracezl::decodeColumns(format, fields, src, entry.compressedSize, buffers);
+            tracezl::PooledBuffer chunk;
+            if (!streams) {
+                chunk = tracezl::decodeChunk(format, fields, src, entry.compressedSize, buffers);
+            }
+            const size_t decoded = streams ? streams->numInstrs * instrSize : chunk.size();
+            if (decoded != entry.uncompressedSize) {
+                throw std::runtime_error("Frame at offset " +
+                                         std::to_string(entry.compressedOffset) +
+                                         " does not match its index entry");
+            }
+
+            TraceSummary* partial = partials.acquire();
+            tracezl::withFormat(format, [&](auto fmt) {
+                using Format = decltype(fmt);
+                if (streams) {
+                    summarizeStreams<Format>(*streams, fields, *partial);
+                } else {
+                    summarizeRecords<Format>(
+                        reinterpret_cast<const typename Format::Record*>(chunk.data()),
+                        chunk.size() / instrSize, *partial, buffers);
+                }
+            });
+            partials.release(partial);
+        }));
+    }
+
+    for (size_t i = 0; i < futures.size(); ++i) {
+        futures[i].get();
+        log << "\rAnalyzed: " << ((i + 1) * 100 / futures.size()) << "%" << std::flush;
+    }
+    log << std::endl;
+
+    // Fold the partials into the first; each key set is merged on its own worker
+    std::vector<std::unique_ptr<TraceSummary>>& all = partials.all();
+    TraceSummary empty;
+    TraceSummary& total = all.empty() ? empty : *all.front();
+    if (all.size() > 1) {
+        std::vector<std::future<void>> merges;
+        for (KeySet TraceSummary::*set : {&TraceSummary::ips, &TraceSummary::lines,
+                                          &TraceSummary::pages}) {
+            merges.push_back(pool.run([&all, set]() {
+                for (size_t i = 1; i < all.size(); ++i) ((*all[0]).*set).merge((*all[i]).*set);
+            }));
+        }
+        for (size_t i = 1; i < all.size(); ++i) total.mergeCounts(*all[i]);
+        for (auto& merge : merges) merge.get();
+    }
+
+    const double elapsed =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    log << "Summarized " << total.instrs << " instructions in " << elapsed << " s ("
+        << index->totalUncompressed() / 1e6 / elapsed << " MB/s decoded)." << std::endl;
+
+    if (options.json) {
+        printSummaryJson(std::cout, compressed_path, format, total);
+    } else {
+        printSummary(std::cout, total);
+    }
+}
@@ -0,0 +1,540 @@
+#include "trace_codec.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include "common.h"
+#include "openzl/zl_ctransform.h"
+#include "openzl/zl_dtransform.h"
+#include "openzl/zl_errors.h"
+#include "stats.h"
+#include "trace_format.h"
+#include "trace_model.h"
+#include "transpose.h"
+
+namespace tracezl {
+
+namespace {
+
+const ZL_Type kStreamTypes[MAX_TAGS] = {ZL_Type_numeric, ZL_Type_numeric, ZL_Type_numeric,
+                                        ZL_Type_numeric, ZL_Type_numeric, ZL_Type_numeric,
+                                        ZL_Type_numeric, ZL_Type_numeric, ZL_Type_numeric};
+
+uint64_t load64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+void store64(uint8_t* p, uint64_t v) { std::memcpy(p, &v, sizeof(v)); }
+
+// Field splitter with empty slot elimination for one record layout
+template <class Format>
+struct SparseFieldSplit {
+    static constexpr size_t kRecordSize = sizeof(typename Format::Record);
+    static constexpr size_t kDest = Format::kDestSlots;
+    static constexpr size_t kSource = Format::kSourceSlots;
+
+    static constexpr size_t extraBytes() {
+        size_t total = 0;
+        for (const ByteRange& range : Format::kExtra) total += range.size;
+        return total;
+    }
+    static constexpr size_t kExtraBytes = extraBytes();
+    static constexpr size_t kNumStreams = kExtraBytes ? MAX_TAGS : TAG_EXTRA;
+
+    // Occupancy bitmap of one record: bit set when the slot is non-zero. Only
+    // occupied slots are written to the register and address streams.
+    using Transpose = RecordTranspose<Format>;
+    static constexpr unsigned kOccDestMem = Transpose::kOccDestMem;
+    static constexpr unsigned kOccSourceMem = Transpose::kOccSourceMem;
+    static constexpr unsigned kOccDestRegs = Transpose::kOccDestRegs;
+    static constexpr unsigned kOccSourceRegs = Transpose::kOccSourceRegs;
+
+    // Element width of each stream
+    static constexpr size_t kWidths[MAX_TAGS] = {8, 1, 1, 1, 1, 8, 8, sizeof(uint16_t), 1};
+    // Worst-case elements per record of each stream
+    static constexpr size_t kPerRecord[MAX_TAGS] = {1,     1,       1, kDest,      kSource,
+                                                    kDest, kSource, 1, kExtraBytes};
+
+    // Split records into caller-provided stream buffers of the worst-case
+    // sizes, dropping empty register and memory slots and applying all value
+    // models to what is left. Returns false if the predictor cannot be
+    // allocated.
+    static bool split(const uint8_t* records, size_t numInstrs, void* const outs[MAX_TAGS],
+                      size_t counts[MAX_TAGS]) {
+        uint64_t* const ips = (uint64_t*)outs[TAG_IP];
+        uint8_t* const isBranch = (uint8_t*)outs[TAG_IS_BRANCH];
+        uint8_t* const taken = (uint8_t*)outs[TAG_BRANCH_TAKEN];
+        uint8_t* const destRegs = (uint8_t*)outs[TAG_DEST_REGS];
+        uint8_t* const srcRegs = (uint8_t*)outs[TAG_SOURCE_REGS];
+        uint64_t* const destMem = (uint64_t*)outs[TAG_DEST_MEM];
+        uint64_t* const srcMem = (uint64_t*)outs[TAG_SOURCE_MEM];
+        uint16_t* const occupancy = (uint16_t*)outs[TAG_OCCUPANCY];
+        uint8_t* extra = kExtraBytes ? (uint8_t*)outs[TAG_EXTRA] : nullptr;
+
+        StridePredictor predictor;
+        if (!predictor.init(kDest + kSource)) return false;
+
+        // Everything but the addresses is moved by the transpose kernel
+        const RegCounts regs = Transpose::gather(simdLevel(), records, numInstrs,
+                                                 {.ips = ips,
+                                                  .isBranch = isBranch,
+                                                  .taken = taken,
+                                                  .occupancy = occupancy,
+                                                  .destRegs = destRegs,
+                                                  .srcRegs = srcRegs});
+        const size_t numDestRegs = regs.dest, numSrcRegs = regs.source;
+
+        constexpr unsigned kMemBits = ((1u << (kDest + kSource)) - 1) << kOccDestMem;
+        size_t numDestMem = 0, numSrcMem = 0;
+        uint64_t prevIp = 0;
+        for (size_t i = 0; i < numInstrs; ++i) {
+            const uint8_t* const r = records + i * kRecordSize;
+            const uint64_t ip = ips[i];
+
+            ips[i] = ip - prevIp;
+            prevIp = ip;
+
+            // Occupied slots in order, destinations first
+            for (unsigned occ = occupancy[i] & kMemBits; occ; occ &= occ - 1) {
+                const unsigned s = __builtin_ctz(occ) - kOccDestMem;
+                const uint64_t addr = load64(r + Format::kDestMem + 8 * s);
+                if (s < kDest) {
+                    destMem[numDestMem++] = predictor.encode(ip, s, addr);
+                } else {
+                    srcMem[numSrcMem++] = predictor.encode(ip, s, addr);
+                }
+            }
+
+            for (const ByteRange& range : Format::kExtra) {
+                std::memcpy(extra, r + range.offset, range.size);
+                extra += range.size;
+            }
+        }
+        const size_t filled[MAX_TAGS] = {numInstrs,  numInstrs, numInstrs,
+                                         numDestRegs, numSrcRegs, numDestMem,
+                                         numSrcMem,  numInstrs, numInstrs * kExtraBytes};
+        std::copy(filled, filled + MAX_TAGS, counts);
+        return true;
+    }
+
+    static ZL_Report encode(ZL_Encoder* eictx, const ZL_Input* input) noexcept {
+        ZL_RESULT_DECLARE_SCOPE_REPORT(eictx);
+        StageTimer timer(threadStats());
+
+        const size_t inputSize = ZL_Input_numElts(input);
+        ZL_ERR_IF_NE(inputSize % kRecordSize, 0, node_invalid_input,
+                     "Trace chunk is not a whole number of records");
+        const size_t numInstrs = inputSize / kRecordSize;
+        const uint8_t* const records = (const uint8_t*)ZL_Input_ptr(input);
+
+        // Streams are sized for the dense worst case and committed at their fill
+        ZL_Output* outs[MAX_TAGS];
+        void* buffers[MAX_TAGS] = {};
+        for (size_t i = 0; i < kNumStreams; ++i) {
+            outs[i] = ZL_Encoder_createTypedStream(eictx, (int)i, numInstrs * kPerRecord[i],
+                                                   kWidths[i]);
+            ZL_ERR_IF_NULL(outs[i], allocation);
+            buffers[i] = ZL_Output_ptr(outs[i]);
+        }
+
+        size_t counts[MAX_TAGS];
+        ZL_ERR_IF(!split(records, numInstrs, buffers, counts), allocation);
+
+        // Models the frame uses, recorded for the decoder
+        const uint8_t flags = MODEL_ALL;
+        ZL_Encoder_sendCodecHeader(eictx, &flags, sizeof(flags));
+
+        for (size_t i = 0; i < kNumStreams; ++i) {
+            ZL_ERR_IF_ERR(ZL_Output_commit(outs[i], counts[i]));
+        }
+
+        if (CompressStats* stats = threadStats()) {
+            for (size_t i = 0; i < kNumStreams; ++i) stats->fieldBytes[i] += counts[i] * kWidths[i];
+        }
+        timer.stop(STAGE_SPLIT);
+
+        return ZL_returnSuccess();
+    }
+
+    // Check decoded streams against the widths above and against each other.
+    // Only the streams in `streams` are looked at.
+    static bool validate(const StreamView in[MAX_TAGS], size_t numInstrs, uint32_t streams) {
+        for (size_t i = 0; i < kNumStreams; ++i) {
+            // Empty streams decode without an element width
+            if ((streams & fieldBit(i)) && in[i].numElts && in[i].eltWidth != kWidths[i]) {
+                return false;
+            }
+        }
+        for (int tag : {TAG_IP, TAG_IS_BRANCH, TAG_BRANCH_TAKEN, TAG_OCCUPANCY}) {
+            if ((streams & fieldBit(tag)) && in[tag].numElts != numInstrs) return false;
+        }
+        if (kExtraBytes && (streams & fieldBit(TAG_EXTRA)) &&
+            in[TAG_EXTRA].numElts != numInstrs * kExtraBytes) {
+            return false;
+        }
+        if (!(streams & fieldBit(TAG_OCCUPANCY))) return true;
+
+        // Bits past the last slot are never written, and the merge kernels
+        // would take them for slots
+        const uint16_t* const occupancy = (const uint16_t*)in[TAG_OCCUPANCY].data;
+        constexpr unsigned kUsedBits = (1u << (kOccSourceRegs + kSource)) - 1;
+        unsigned bits = 0;
+        for (size_t i = 0; i < numInstrs; ++i) bits |= occupancy[i];
+        if (bits & ~kUsedBits) return false;
+
+        // The bitmap must account for exactly the slots present in each stream
+        const struct {
+            int tag;
+            unsigned shift;
+            size_t slots;
+        } sparseStreams[] = {{TAG_DEST_REGS, kOccDestRegs, kDest},
+                             {TAG_SOURCE_REGS, kOccSourceRegs, kSource},
+                             {TAG_DEST_MEM, kOccDestMem, kDest},
+                             {TAG_SOURCE_MEM, kOccSourceMem, kSource}};
+        for (const auto& stream : sparseStreams) {
+            if (!(streams & fieldBit(stream.tag))) continue;
+            const unsigned mask = ((1u << stream.slots) - 1) << stream.shift;
+            size_t present = 0;
+            for (size_t i = 0; i < numInstrs; ++i) {
+                present += __builtin_popcount(occupancy[i] & mask);
+            }
+            if (in[stream.tag].numElts != present) return false;
+        }
+        return true;
+    }
+
+    // Rebuild the `fields` of records from validated sparse field streams,
+    // refilling empty slots and other fields with zero. Returns false if the
+    // predictor cannot be allocated.
+    static bool merge(const StreamView in[MAX_TAGS], size_t numInstrs, uint8_t flags,
+                      FieldMask fields, uint8_t* records) {
+        const uint64_t* const ips = (const uint64_t*)in[TAG_IP].data;
+        const uint8_t* const isBranch = (const uint8_t*)in[TAG_IS_BRANCH].data;
+        const uint8_t* const taken = (const uint8_t*)in[TAG_BRANCH_TAKEN].data;
+        const uint8_t* const destRegs = (const uint8_t*)in[TAG_DEST_REGS].data;
+        const uint8_t* const srcRegs = (const uint8_t*)in[TAG_SOURCE_REGS].data;
+        const uint64_t* const destMem = (const uint64_t*)in[TAG_DEST_MEM].data;
+        const uint64_t* const srcMem = (const uint64_t*)in[TAG_SOURCE_MEM].data;
+        const uint16_t* const occupancy = (const uint16_t*)in[TAG_OCCUPANCY].data;
+        const uint8_t* extra = (const uint8_t*)in[TAG_EXTRA].data;
+
+        // The transpose kernel rebuilds the branch bytes and registers when
+        // all of them are wanted; the loop below does the rest
+        const FieldMask transposed = fieldBit(TAG_IS_BRANCH) | fieldBit(TAG_BRANCH_TAKEN) |
+                                     fieldBit(TAG_DEST_REGS) | fieldBit(TAG_SOURCE_REGS);
+        const bool useKernel = (fields & transposed) == transposed;
+
+        // Loop-invariant, so a full decode pays predictable branches only
+        const bool wantIp = fields & fieldBit(TAG_IP);
+        const bool wantBranch = !useKernel && (fields & fieldBit(TAG_IS_BRANCH));
+        const bool wantTaken = !useKernel && (fields & fieldBit(TAG_BRANCH_TAKEN));
+        const bool wantDestRegs = !useKernel && (fields & fieldBit(TAG_DEST_REGS));
+        const bool wantSrcRegs = !useKernel && (fields & fieldBit(TAG_SOURCE_REGS));
+        const bool wantDestMem = fields & fieldBit(TAG_DEST_MEM);
+        const bool wantSrcMem = fields & fieldBit(TAG_SOURCE_MEM);
+        const bool wantExtra = kExtraBytes && (fields & fieldBit(TAG_EXTRA));
+        const bool needIp = wantIp || wantDestMem || wantSrcMem;
+        if ((fields & kAllFields) != kAllFields) std::memset(records, 0, numInstrs * kRecordSize);
+
+        StridePredictor predictor;
+        if ((flags & MODEL_ADDR_STRIDE) && (wantDestMem || wantSrcMem) &&
+            !predictor.init(kDest + kSource)) {
+            return false;
+        }
+
+        if (useKernel) {
+            Transpose::scatter(simdLevel(),
+                               {.isBranch = isBranch,
+                                .taken = taken,
+                                .occupancy = occupancy,
+                                .destRegs = destRegs,
+                                .numDestRegs = in[TAG_DEST_REGS].numElts,
+                                .srcRegs = srcRegs,
+                                .numSrcRegs = in[TAG_SOURCE_REGS].numElts},
+                               numInstrs, records);
+        }
+
+        size_t numDestRegs = 0, numSrcRegs = 0, numDestMem = 0, numSrcMem = 0;
+        uint64_t ip = 0;
+        for (size_t i = 0; i < numInstrs; ++i) {
+            uint8_t* const r = records + i * kRecordSize;
+
+            if (needIp) ip = (flags & MODEL_IP_DELTA) ? ip + ips[i] : ips[i];
+            if (wantIp) store64(r + Format::kIp, ip);
+            if (wantBranch) r[Format::kIsBranch] = isBranch[i];
+            if (wantTaken) r[Format::kBranchTaken] = taken[i];
+
+            const unsigned occ = (wantDestRegs || wantSrcRegs || wantDestMem || wantSrcMem)
+                                     ? occupancy[i]
+                                     : 0;
+            if (wantDestRegs) {
+                for (unsigned s = 0; s < kDest; ++s) {
+                    r[Format::kDestRegs + s] =
+                        (occ >> (kOccDestRegs + s) & 1) ? destRegs[numDestRegs++] : 0;
+                }
+            }
+            if (wantSrcRegs) {
+                for (unsigned s = 0; s < kSource; ++s) {
+                    r[Format::kSourceRegs + s] =
+                        (occ >> (kOccSourceRegs + s) & 1) ? srcRegs[numSrcRegs++] : 0;
+                }
+            }
+            if (wantDestMem) {
+                for (unsigned s = 0; s < kDest; ++s) {
+                    uint64_t addr = 0;
+                    if (occ >> (kOccDestMem + s) & 1) {
+                        addr = destMem[numDestMem++];
+                        if (flags & MODEL_ADDR_STRIDE) addr = predictor.decode(ip, s, addr);
+                    }
+                    store64(r + Format::kDestMem + 8 * s, addr);
+                }
+            }
+            if (wantSrcMem) {
+                for (unsigned s = 0; s < kSource; ++s) {
+                    uint64_t addr = 0;
+                    if (occ >> (kOccSourceMem + s) & 1) {
+                        addr = srcMem[numSrcMem++];
+                        if (flags & MODEL_ADDR_STRIDE) {
+                            addr = predictor.decode(ip, kDest + s, addr);
+                        }
+                    }
+                    store64(r + Format::kSourceMem + 8 * s, addr);
+                }
+            }
+
+            if (wantExtra) {
+                for (const ByteRange& range : Format::kExtra) {
+                    std::memcpy(r + range.offset, extra, range.size);
+                    extra += range.size;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Undo the value models of validated streams without rebuilding records:
+    // absolute IPs go to `ips` and the addresses of occupied slots, in stream
+    // order, to `destMem` and `srcMem`. Outputs may alias their streams.
+    // Returns false if the predictor cannot be allocated.
+    static bool unmodel(const StreamView in[MAX_TAGS], size_t numInstrs, uint8_t flags,
+                        uint64_t* ips, uint64_t* destMem, uint64_t* srcMem) {
+        const uint64_t* const ipIn = (const uint64_t*)in[TAG_IP].data;
+        const uint64_t* const destIn = (const uint64_t*)in[TAG_DEST_MEM].data;
+        const uint64_t* const srcIn = (const uint64_t*)in[TAG_SOURCE_MEM].data;
+        const uint16_t* const occupancy = (const uint16_t*)in[TAG_OCCUPANCY].data;
+
+        StridePredictor predictor;
+        const bool stride = flags & MODEL_ADDR_STRIDE;
+        if (stride && !predictor.init(kDest + kSource)) return false;
+
+        size_t numDestMem = 0, numSrcMem = 0;
+        uint64_t ip = 0;
+        for (size_t i = 0; i < numInstrs; ++i) {
+            ip = (flags & MODEL_IP_DELTA) ? ip + ipIn[i] : ipIn[i];
+            ips[i] = ip;
+
+            const unsigned occ = occupancy[i];
+            for (unsigned s = 0; s < kDest; ++s) {
+                if (!(occ >> (kOccDestMem + s) & 1)) continue;
+                const uint64_t addr = destIn[numDestMem];
+                destMem[numDestMem++] = stride ? predictor.decode(ip, s, addr) : addr;
+            }
+            for (unsigned s = 0; s < kSource; ++s) {
+                if (!(occ >> (kOccSourceMem + s) & 1)) continue;
+                const uint64_t addr = srcIn[numSrcMem];
+                srcMem[numSrcMem++] = stride ? predictor.decode(ip, kDest + s, addr) : addr;
+            }
+        }
+        return true;
+    }
+
+    // Zero every field of whole records outside `fields`
+    static void mask(uint8_t* records, size_t numInstrs, FieldMask fields) {
+        const ByteRange ranges[] = {{Format::kIp, 8},
+                                    {Format::kIsBranch, 1},
+                                    {Format::kBranchTaken, 1},
+                                    {Format::kDestRegs, kDest},
+                                    {Format::kSourceRegs, kSource},
+                                    {Format::kDestMem, 8 * kDest},
+                                    {Format::kSourceMem, 8 * kSource}};
+        for (size_t i = 0; i < numInstrs; ++i) {
+            uint8_t* const r = records + i * kRecordSize;
+            for (int tag = 0; tag < NUM_FIELDS; ++tag) {
+                if (!(fields & fieldBit(tag))) {
+                    std::memset(r + ranges[tag].offset, 0, ranges[tag].size);
+                }
+            }
+            if (!(fields & fieldBit(TAG_EXTRA))) {
+                for (const ByteRange& range : Format::kExtra) {
+                    std::memset(r + range.offset, 0, range.size);
+                }
+            }
+        }
+    }
+
+    static ZL_Report decode(ZL_Decoder* dictx, const ZL_Input* inputs[]) noexcept {
+        ZL_RESULT_DECLARE_SCOPE_REPORT(dictx);
+
+        const ZL_RBuffer header = ZL_Decoder_getCodecHeader(dictx);
+        ZL_ERR_IF_NE(header.size, 1, corruption);
+        const uint8_t flags = *(const uint8_t*)header.start;
+        ZL_ERR_IF(flags & ~MODEL_ALL, corruption, "Unknown trace model flags");
+
+        StreamView streams[MAX_TAGS] = {};
+        for (size_t i = 0; i < kNumStreams; ++i) {
+            streams[i] = {.data = ZL_Input_ptr(inputs[i]),
+                          .numElts = ZL_Input_numElts(inputs[i]),
+                          .eltWidth = ZL_Input_eltWidth(inputs[i])};
+        }
+        const size_t numInstrs = streams[TAG_IP].numElts;
+        ZL_ERR_IF(!validate(streams, numInstrs, fieldBit(kNumStreams) - 1), corruption,
+                  "Field streams do not match the occupancy bitmap");
+
+        const size_t outSize = numInstrs * kRecordSize;
+        ZL_Output* out = ZL_Decoder_create1OutStream(dictx, outSize, 1);
+        ZL_ERR_IF_NULL(out, allocation);
+        ZL_ERR_IF(!merge(streams, numInstrs, flags, kAllFields, (uint8_t*)ZL_Output_ptr(out)),
+                  allocation);
+        ZL_ERR_IF_ERR(ZL_Output_commit(out, outSize));
+
+        return ZL_returnSuccess();
+    }
+};
+
+// Codec identity of each layout. IDs are part of the frame format.
+template <class Format>
+struct SparseCodecInfo;
+
+template <>
+struct SparseCodecInfo<ChampSimFormat> {
+    static constexpr ZL_IDType kID = kFieldSplitCodecID;
+    static constexpr const char* kName = "tracezl.field_split";
+};
+
+template <>
+struct SparseCodecInfo<CloudSuiteFormat> {
+    static constexpr ZL_IDType kID = kCloudSuiteFieldSplitCodecID;
+    static constexpr const char* kName = "tracezl.cloudsuite.field_split";
+};
+
+template <class Format>
+ZL_TypedGraphDesc sparseGraphDesc() {
+    return {.CTid = SparseCodecInfo<Format>::kID,
+            .inStreamType = ZL_Type_serial,
+            .outStreamTypes = kStreamTypes,
+            .nbOutStreams = SparseFieldSplit<Format>::kNumStreams};
+}
+
+template <class Format>
+void registerSparseDecoder(openzl::DCtx& dctx) {
+    ZL_TypedDecoderDesc desc = {.gd = sparseGraphDesc<Format>(),
+                                .transform_f = SparseFieldSplit<Format>::decode,
+                                .name = SparseCodecInfo<Format>::kName};
+    openzl::unwrap(ZL_DCtx_registerTypedDecoder(dctx.get(), &desc),
+                   "Failed to register sparse field split decoder");
+}
+
+}  // namespace
+
+ZL_NodeID registerFieldSplitEncoder(openzl::Compressor& compressor, TraceFormat format) {
+    return withFormat(format, [&](auto desc) {
+        using Format = decltype(desc);
+        auto existing = compressor.getNode(SparseCodecInfo<Format>::kName);
+        if (existing) return existing.value();
+
+        ZL_TypedEncoderDesc encoder = {.gd = sparseGraphDesc<Format>(),
+                                       .transform_f = SparseFieldSplit<Format>::encode,
+                                       .localParams = {},
+                                       .name = SparseCodecInfo<Format>::kName};
+        return ZL_Compressor_registerTypedEncoder(compressor.get(), &encoder);
+    });
+}
+
+size_t fieldSplitStreams(TraceFormat format) {
+    return withFormat(format,
+                      [](auto desc) { return SparseFieldSplit<decltype(desc)>::kNumStreams; });
+}
+
+size_t splitFields(TraceFormat format, const void* src, size_t size, BufferPool& pool,
+                   FieldStream streams[MAX_TAGS]) {
+    return withFormat(format, [&](auto desc) {
+        using Split = SparseFieldSplit<decltype(desc)>;
+        const size_t numInstrs = size / Split::kRecordSize;
+
+        void* buffers[MAX_TAGS] = {};
+        for (size_t i = 0; i < Split::kNumStreams; ++i) {
+            streams[i].eltWidth = Split::kWidths[i];
+            streams[i].data = pool.acquire(numInstrs * Split::kPerRecord[i] * Split::kWidths[i]);
+            buffers[i] = streams[i].data.data();
+        }
+
+        size_t counts[MAX_TAGS];
+        if (!Split::split((const uint8_t*)src, numInstrs, buffers, counts)) {
+            throw std::bad_alloc();
+        }
+        for (size_t i = 0; i < Split::kNumStreams; ++i) {
+            streams[i].data.resize(counts[i] * Split::kWidths[i]);
+        }
+        return Split::kNumStreams;
+    });
+}
+
+uint32_t streamsForFields(FieldMask fields) {
+    const FieldMask regs = fieldBit(TAG_DEST_REGS) | fieldBit(TAG_SOURCE_REGS);
+    const FieldMask mem = fieldBit(TAG_DEST_MEM) | fieldBit(TAG_SOURCE_MEM);
+    uint32_t streams = fields & kAllFields;
+    // Slots are found through the bitmap, and addresses are predicted per IP
+    if (fields & (regs | mem)) streams |= fieldBit(TAG_OCCUPANCY);
+    if (fields & mem) streams |= fieldBit(TAG_IP);
+    return streams;
+}
+
+void mergeFields(TraceFormat format, const StreamView streams[MAX_TAGS], size_t numInstrs,
+                 uint8_t modelFlags, FieldMask fields, void* records) {
+    withFormat(format, [&](auto desc) {
+        using Split = SparseFieldSplit<decltype(desc)>;
+        if (modelFlags & ~MODEL_ALL) throw std::runtime_error("Unknown trace model flags");
+        const uint32_t needed = streamsForFields(fields) & (fieldBit(Split::kNumStreams) - 1);
+        if (!Split::validate(streams, numInstrs, needed)) {
+            throw std::runtime_error("Field streams do not match the occupancy bitmap");
+        }
+        if (!Split::merge(streams, numInstrs, modelFlags, fields, (uint8_t*)records)) {
+            throw std::bad_alloc();
+        }
+    });
+}
+
+void unmodelFields(TraceFormat format, const StreamView streams[MAX_TAGS], size_t numInstrs,
+                   uint8_t modelFlags, FieldMask fields, uint64_t* ips, uint64_t* destMem,
+                   uint64_t* srcMem) {
+    withFormat(format, [&](auto desc) {
+        using Split = SparseFieldSplit<decltype(desc)>;
+        if (modelFlags & ~MODEL_ALL) throw std::runtime_error("Unknown trace model flags");
+        const FieldMask mem = fieldBit(TAG_DEST_MEM) | fieldBit(TAG_SOURCE_MEM);
+        const uint32_t needed = streamsForFields(fields | mem) & (fieldBit(Split::kNumStreams) - 1);
+        if (!Split::validate(streams, numInstrs, needed)) {
+            throw std::runtime_error("Field streams do not match the occupancy bitmap");
+        }
+        if (!Split::unmodel(streams, numInstrs, modelFlags, ips, destMem, srcMem)) {
+            throw std::bad_alloc();
+        }
+    });
+}
+
+void maskFields(TraceFormat format, void* records, size_t numInstrs, FieldMask fields) {
+    withFormat(format, [&](auto desc) {
+        SparseFieldSplit<decltype(desc)>::mask((uint8_t*)records, numInstrs, fields);
+    });
+}
+
+void registerDecoders(openzl::DCtx& dctx) {
+    registerSparseDecoder<ChampSimFormat>(dctx);
+    registerSparseDecoder<CloudSuiteFormat>(dctx);
+}
+
+}  // namespace tracezl
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "buffer_pool.h"
+#include "common.h"
+#include "openzl/cpp/Compressor.hpp"
+#include "openzl/cpp/DCtx.hpp"
+#include "openzl/zl_graph_api.h"
+#include "trace_format.h"
+
+namespace tracezl {
+
+// Custom transform IDs of the fixed-stride field splitter, one per layout
+constexpr ZL_IDType kFieldSplitCodecID = 1;
+constexpr ZL_IDType kCloudSuiteFieldSplitCodecID = 2;
+
+// Register the record -> field streams encoder for `format` and return its node.
+ZL_NodeID registerFieldSplitEncoder(openzl::Compressor& compressor, TraceFormat format);
+
+// Number of streams the encoder for `format` emits
+size_t fieldSplitStreams(TraceFormat format);
+
+// One field stream as the encoder emits it
+struct FieldStream {
+    PooledBuffer data;
+    size_t eltWidth;
+};
+
+// Split whole records outside a compression graph, into the same streams the
+// encoder for `format` emits, with every value model applied. Fills the
+// first fieldSplitStreams(format) entries of `streams` and returns their
+// number. Used for column frames and to attribute compressed size to fields.
+size_t splitFields(TraceFormat format, const void* src, size_t size, BufferPool& pool,
+                   FieldStream streams[MAX_TAGS]);
+
+// A decoded field stream
+struct StreamView {
+    const void* data;
+    size_t numElts;
+    size_t eltWidth;
+};
+
+// Streams the `fields` of a record are rebuilt from, one bit per FieldTag
+uint32_t streamsForFields(FieldMask fields);
+
+// Rebuild the `fields` of `numInstrs` records of `format` from the decoded
+// streams of splitFields(), zeroing every other field. Only the streams named
+// by streamsForFields(fields) are read. Throws if they do not fit together.
+void mergeFields(TraceFormat format, const StreamView streams[MAX_TAGS], size_t numInstrs,
+                 uint8_t modelFlags, FieldMask fields, void* records);
+
+// Check the decoded streams of `fields` as mergeFields() does, along with
+// the IP, occupancy and memory streams, and undo their value models without
+// rebuilding records: absolute IPs go to `ips` and the addresses of occupied
+// slots, in stream order, to `destMem` and `srcMem`. Each output may be the
+// stream it replaces. Throws if the streams do not fit together.
+void unmodelFields(TraceFormat format, const StreamView streams[MAX_TAGS], size_t numInstrs,
+                   uint8_t modelFlags, FieldMask fields, uint64_t* ips, uint64_t* destMem,
+                   uint64_t* srcMem);
+
+// Zero the fields of whole records outside `fields`
+void maskFields(TraceFormat format, void* records, size_t numInstrs, FieldMask fields);
+
+// Register every tracezl custom decoder. Must be called on each DCtx before
+// decompressing a tracezl frame.
+void registerDecoders(openzl::DCtx& dctx);
+
+}  // namespace tracezl
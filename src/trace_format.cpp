@@ -0,0 +1,59 @@
+#include "trace_format.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace tracezl {
+
+const char* const kFieldNames[MAX_TAGS] = {"ip",          "is_branch", "branch_taken",
+                                           "dest_regs",   "src_regs",  "dest_mem",
+                                           "src_mem",     "occupancy", "extra"};
+
+FieldMask parseFields(const std::string& list) {
+    FieldMask fields = 0;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        const std::string name = list.substr(start, end - start);
+        const char* const* found = std::find(kFieldNames, kFieldNames + MAX_TAGS, name);
+        if (found == kFieldNames + MAX_TAGS || found - kFieldNames == TAG_OCCUPANCY) {
+            throw std::runtime_error("Unknown field '" + name + "'");
+        }
+        fields |= fieldBit(found - kFieldNames);
+        start = end + 1;
+    }
+    return fields;
+}
+
+size_t recordSize(TraceFormat format) {
+    return withFormat(format, [](auto desc) {
+        return sizeof(typename decltype(desc)::Record);
+    });
+}
+
+const char* formatName(TraceFormat format) {
+    switch (format) {
+        case TraceFormat::ChampSim:
+            return "champsim";
+        case TraceFormat::CloudSuite:
+            return "cloudsuite";
+    }
+    return "unknown";
+}
+
+std::optional<TraceFormat> parseFormat(const std::string& name) {
+    for (TraceFormat format : {TraceFormat::ChampSim, TraceFormat::CloudSuite}) {
+        if (name == formatName(format)) return format;
+    }
+    return std::nullopt;
+}
+
+std::optional<TraceFormat> formatFromId(uint16_t id) {
+    for (TraceFormat format : {TraceFormat::ChampSim, TraceFormat::CloudSuite}) {
+        if (id == (uint16_t)format) return format;
+    }
+    return std::nullopt;
+}
+
+}  // namespace tracezl
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "champsim_trace.h"
+
+namespace tracezl {
+
+// Fixed-size trace record layouts tracezl can compress. The numeric value is
+// stored in archives, so entries must never be renumbered.
+//
+// CVP-1 traces are not covered: their records are variable length, so they
+// cannot go through a fixed-stride splitter.
+enum class TraceFormat : uint16_t {
+    ChampSim = 0,
+    CloudSuite = 1,
+};
+
+// Define tags for our fields. The field splitter emits one stream per field
+// followed by the slot occupancy bitmap and, for formats with bytes outside
+// the common fields, the verbatim extra bytes.
+enum FieldTag {
+    TAG_IP = 0,
+    TAG_IS_BRANCH,
+    TAG_BRANCH_TAKEN,
+    TAG_DEST_REGS,
+    TAG_SOURCE_REGS,
+    TAG_DEST_MEM,
+    TAG_SOURCE_MEM,
+    NUM_FIELDS,
+    TAG_OCCUPANCY = NUM_FIELDS,
+    TAG_EXTRA,
+    MAX_TAGS
+};
+
+// Set of record fields, one bit per FieldTag. TAG_EXTRA stands for the bytes
+// outside the common fields; the occupancy bitmap is not a field.
+using FieldMask = uint32_t;
+constexpr FieldMask fieldBit(int tag) { return FieldMask(1) << tag; }
+constexpr FieldMask kAllFields = (fieldBit(MAX_TAGS) - 1) & ~fieldBit(TAG_OCCUPANCY);
+
+// Stream names, as printed by --stats and accepted by --fields
+extern const char* const kFieldNames[MAX_TAGS];
+// Parse a comma-separated list of field names
+FieldMask parseFields(const std::string& list);
+
+// Byte range of a record copied verbatim into the extra stream
+struct ByteRange {
+    size_t offset;
+    size_t size;
+};
+
+// Compile-time layout descriptors. The field splitter is instantiated once
+// per descriptor, so every offset and slot count below is a constant in the
+// hot loops. Bytes not covered by a field (padding, format-specific fields)
+// are listed in kExtra so records round-trip bit for bit.
+struct ChampSimFormat {
+    using Record = trace_instr_format_t;
+    static constexpr TraceFormat kFormat = TraceFormat::ChampSim;
+
+    static constexpr size_t kDestSlots = NUM_INSTR_DESTINATIONS;
+    static constexpr size_t kSourceSlots = NUM_INSTR_SOURCES;
+
+    static constexpr size_t kIp = offsetof(Record, ip);
+    static constexpr size_t kIsBranch = offsetof(Record, is_branch);
+    static constexpr size_t kBranchTaken = offsetof(Record, branch_taken);
+    static constexpr size_t kDestRegs = offsetof(Record, destination_registers);
+    static constexpr size_t kSourceRegs = offsetof(Record, source_registers);
+    static constexpr size_t kDestMem = offsetof(Record, destination_memory);
+    static constexpr size_t kSourceMem = offsetof(Record, source_memory);
+
+    static constexpr std::array<ByteRange, 0> kExtra = {};
+};
+
+struct CloudSuiteFormat {
+    using Record = cloudsuite_instr_format_t;
+    static constexpr TraceFormat kFormat = TraceFormat::CloudSuite;
+
+    static constexpr size_t kDestSlots = NUM_INSTR_DESTINATIONS_SPARC;
+    static constexpr size_t kSourceSlots = NUM_INSTR_SOURCES;
+
+    static constexpr size_t kIp = offsetof(Record, ip);
+    static constexpr size_t kIsBranch = offsetof(Record, is_branch);
+    static constexpr size_t kBranchTaken = offsetof(Record, branch_taken);
+    static constexpr size_t kDestRegs = offsetof(Record, destination_registers);
+    static constexpr size_t kSourceRegs = offsetof(Record, source_registers);
+    static constexpr size_t kDestMem = offsetof(Record, destination_memory);
+    static constexpr size_t kSourceMem = offsetof(Record, source_memory);
+
+    // Padding after the registers, the ASID, and the tail padding
+    static constexpr std::array<ByteRange, 2> kExtra = {{
+        {kSourceRegs + kSourceSlots, kDestMem - (kSourceRegs + kSourceSlots)},
+        {offsetof(Record, asid), sizeof(Record) - offsetof(Record, asid)},
+    }};
+};
+
+static_assert(sizeof(ChampSimFormat::Record) == 64, "unexpected ChampSim record size");
+static_assert(sizeof(CloudSuiteFormat::Record) == 96, "unexpected CloudSuite record size");
+
+// Call fn with the descriptor matching `format`
+template <class Fn>
+decltype(auto) withFormat(TraceFormat format, Fn&& fn) {
+    switch (format) {
+        case TraceFormat::CloudSuite:
+            return fn(CloudSuiteFormat{});
+        case TraceFormat::ChampSim:
+        default:
+            return fn(ChampSimFormat{});
+    }
+}
+
+// Bytes per record
+size_t recordSize(TraceFormat format);
+// Name used on the command line
+const char* formatName(TraceFormat format);
+std::optional<TraceFormat> parseFormat(const std::string& name);
+// Validate a format number read from an archive
+std::optional<TraceFormat> formatFromId(uint16_t id);
+
+}  // namespace tracezl
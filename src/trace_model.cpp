@@ -0,0 +1,26 @@
+#include "trace_model.h"
+
+#include <cstring>
+#include <memory>
+#include <new>
+
+namespace tracezl {
+
+bool StridePredictor::init(size_t numSlots) {
+    // Allocated once per thread; each chunk only clears it
+    thread_local std::unique_ptr<Entry[]> table;
+    thread_local size_t capacity = 0;
+
+    const size_t numEntries = (size_t(1) << kIndexBits) * numSlots;
+    if (numEntries > capacity) {
+        table.reset(new (std::nothrow) Entry[numEntries]);
+        capacity = table ? numEntries : 0;
+        if (!table) return false;
+    }
+    std::memset(table.get(), 0, numEntries * sizeof(Entry));
+    table_ = table.get();
+    numSlots_ = numSlots;
+    return true;
+}
+
+}  // namespace tracezl
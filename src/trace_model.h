@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tracezl {
+
+// Reversible value models applied to the field streams of a chunk. The set
+// applied to a frame is recorded in the field splitter's codec header.
+enum ModelFlags : uint8_t {
+    // IPs are stored as the difference to the previous instruction's IP
+    MODEL_IP_DELTA = 1 << 0,
+    // Memory addresses are stored as the residual against a per-PC stride
+    // prediction: the previous address of the same PC and slot plus the
+    // stride between its last two addresses
+    MODEL_ADDR_STRIDE = 1 << 1,
+
+    MODEL_ALL = MODEL_IP_DELTA | MODEL_ADDR_STRIDE,
+};
+
+// Direct-mapped table of per-PC address history for MODEL_ADDR_STRIDE.
+// Encoder and decoder update it identically, so aliasing between PCs only
+// costs ratio, not correctness. Slots are numbered destinations first.
+//
+// The table belongs to the calling thread and is kept between chunks, so
+// only one predictor per thread may be in use at a time.
+class StridePredictor {
+public:
+    static constexpr unsigned kIndexBits = 12;
+
+    // Clear the thread's table for `numSlots` memory slots per instruction,
+    // growing it if needed. Returns false if it cannot be allocated.
+    bool init(size_t numSlots);
+
+    // Residual of `addr` for slot `slot` of the instruction at `ip`
+    uint64_t encode(uint64_t ip, size_t slot, uint64_t addr) {
+        Entry& e = entry(ip, slot);
+        const uint64_t residual = addr - (e.last + e.stride);
+        e.update(addr);
+        return residual;
+    }
+
+    uint64_t decode(uint64_t ip, size_t slot, uint64_t residual) {
+        Entry& e = entry(ip, slot);
+        const uint64_t addr = residual + (e.last + e.stride);
+        e.update(addr);
+        return addr;
+    }
+
+private:
+    struct Entry {
+        uint64_t last;
+        uint64_t stride;
+
+        void update(uint64_t addr) {
+            stride = addr - last;
+            last = addr;
+        }
+    };
+
+    Entry& entry(uint64_t ip, size_t slot) {
+        const uint64_t hash = ip ^ (ip >> kIndexBits) ^ (ip >> (2 * kIndexBits));
+        const size_t row = hash & ((size_t(1) << kIndexBits) - 1);
+        return table_[row * numSlots_ + slot];
+    }
+
+    Entry* table_ = nullptr;
+    size_t numSlots_ = 0;
+};
+
+}  // namespace tracezl
@@ -0,0 +1,167 @@
+#include "trace_reader.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "columnar.h"
+#include "tools/training/utils/thread_pool.h"
+
+namespace tracezl {
+
+namespace {
+
+PooledBuffer readFrame(int fd, const ChunkIndexEntry& entry, BufferPool& pool) {
+    PooledBuffer frame = pool.acquire(entry.compressedSize);
+    size_t done = 0;
+    while (done < frame.size()) {
+        ssize_t got = pread(fd, frame.data() + done, frame.size() - done,
+                            (off_t)(entry.compressedOffset + done));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) throw std::runtime_error("Failed to read compressed frame");
+        done += got;
+    }
+    return frame;
+}
+
+}  // namespace
+
+template <class Format>
+BasicTraceReader<Format>::BasicTraceReader(const std::string& path, const Options& options)
+    : options_(options) {
+    options_.num_threads = std::max<size_t>(options_.num_threads, 1);
+    options_.read_ahead = std::max<size_t>(options_.read_ahead, 1);
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) throw std::runtime_error("Cannot open compressed file " + path);
+    size_t fileSize = file.tellg();
+    auto index = readChunkIndex(file, fileSize);
+    index_ = index ? std::move(*index) : scanChunkIndex(file, fileSize);
+    if (index_.format() != Format::kFormat) {
+        throw std::runtime_error(path + " holds " + formatName(index_.format()) +
+                                 " records, not " + formatName(Format::kFormat));
+    }
+
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        throw std::runtime_error("Cannot open compressed file " + path + ": " +
+                                 std::strerror(errno));
+    }
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // The destructor does not run for a throwing constructor, so release
+    // what it would: tasks already scheduled read fd_ and finish first
+    try {
+        pool_ = std::make_unique<openzl::training::ThreadPool>(options_.num_threads);
+        schedule();
+    } catch (...) {
+        drain();
+        pool_.reset();
+        close(fd_);
+        throw;
+    }
+}
+
+template <class Format>
+BasicTraceReader<Format>::~BasicTraceReader() {
+    drain();
+    pool_.reset();
+    if (fd_ >= 0) close(fd_);
+}
+
+template <class Format>
+void BasicTraceReader<Format>::schedule() {
+    while (pending_.size() < options_.read_ahead && nextSchedule_ < index_.size()) {
+        const ChunkIndexEntry entry = index_[nextSchedule_++];
+        const int fd = fd_;
+        pending_.push_back(pool_->run([fd, entry, fields = options_.fields, buffers = &buffers_]() {
+            PooledBuffer frame = readFrame(fd, entry, *buffers);
+            return decodeChunk(Format::kFormat, fields, frame.data(), frame.size(), *buffers);
+        }));
+    }
+}
+
+template <class Format>
+bool BasicTraceReader<Format>::advance() {
+    if (pending_.empty()) return false;
+
+    current_ = pending_.front().get();
+    pending_.pop_front();
+    currentChunk_ = nextSchedule_ - pending_.size() - 1;
+
+    // Whole records only; a trailing partial record is not handed out
+    available_ = index_[currentChunk_].numInstrs;
+    if (available_ * sizeof(Record) > current_.size()) {
+        throw std::runtime_error("Chunk " + std::to_string(currentChunk_) +
+                                 " is shorter than its index entry");
+    }
+    cursor_ = 0;
+
+    schedule();
+    return true;
+}
+
+template <class Format>
+void BasicTraceReader<Format>::drain() {
+    // Tasks reference fd_, so they must finish before it is closed or reused
+    for (auto& future : pending_) future.wait();
+    pending_.clear();
+}
+
+template <class Format>
+typename BasicTraceReader<Format>::Batch BasicTraceReader<Format>::nextBatch(size_t maxInstrs) {
+    while (cursor_ == available_) {
+        if (!advance()) return {};
+    }
+
+    const auto* records = reinterpret_cast<const Record*>(current_.data());
+    Batch batch = {.data = records + cursor_, .size = std::min(maxInstrs, available_ - cursor_)};
+    cursor_ += batch.size;
+    return batch;
+}
+
+template <class Format>
+auto BasicTraceReader<Format>::next() -> const Record* {
+    Batch batch = nextBatch(1);
+    return batch.data;
+}
+
+template <class Format>
+bool BasicTraceReader<Format>::read(Record& instr) {
+    const Record* record = next();
+    if (!record) return false;
+    instr = *record;
+    return true;
+}
+
+template <class Format>
+void BasicTraceReader<Format>::seek(uint64_t instr) {
+    drain();
+    current_ = PooledBuffer();
+    cursor_ = available_ = 0;
+
+    nextSchedule_ = index_.findChunk(instr);
+    currentChunk_ = nextSchedule_;
+    schedule();
+    if (nextSchedule_ == currentChunk_) return;  // past the end
+
+    advance();
+    cursor_ = instr - index_.firstInstr(currentChunk_);
+}
+
+template <class Format>
+uint64_t BasicTraceReader<Format>::position() const {
+    if (currentChunk_ >= index_.size()) return totalInstrs();
+    return index_.firstInstr(currentChunk_) + cursor_;
+}
+
+template class BasicTraceReader<ChampSimFormat>;
+template class BasicTraceReader<CloudSuiteFormat>;
+
+}  // namespace tracezl
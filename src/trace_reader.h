@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include "buffer_pool.h"
+#include "container.h"
+#include "trace_format.h"
+
+namespace openzl::training {
+class ThreadPool;
+}
+
+namespace tracezl {
+
+struct TraceReaderOptions {
+    size_t num_threads = 2;
+    // Decoded chunks kept ahead of the consumer
+    size_t read_ahead = 4;
+    // Fields the caller reads; the others are zero. Archives written with
+    // --columnar then skip decoding the streams of the other fields.
+    FieldMask fields = kAllFields;
+};
+
+// Sequential reader over a .zl archive, meant to be linked into a simulator.
+// Frames are read and decoded on background threads while the caller
+// consumes the current chunk, and records are handed out as views into the
+// decoded buffer without further copies. `Format` is the layout descriptor
+// of the archived records (see trace_format.h); opening an archive of
+// another format throws.
+template <class Format>
+class BasicTraceReader {
+public:
+    using Options = TraceReaderOptions;
+    using Record = typename Format::Record;
+
+    // Records of one decoded chunk. Valid until the reader moves past the chunk.
+    struct Batch {
+        const Record* data = nullptr;
+        size_t size = 0;
+
+        bool empty() const { return size == 0; }
+        const Record* begin() const { return data; }
+        const Record* end() const { return data + size; }
+    };
+
+    explicit BasicTraceReader(const std::string& path, const Options& options = {});
+    ~BasicTraceReader();
+
+    BasicTraceReader(const BasicTraceReader&) = delete;
+    BasicTraceReader& operator=(const BasicTraceReader&) = delete;
+
+    // Next record, or nullptr at the end of the trace
+    const Record* next();
+    // Copy the next record into `instr`; false at the end of the trace
+    bool read(Record& instr);
+    // Up to `maxInstrs` records from the current chunk; empty at the end
+    Batch nextBatch(size_t maxInstrs = std::numeric_limits<size_t>::max());
+
+    // Reposition so the next record returned is instruction `instr`
+    void seek(uint64_t instr);
+
+    uint64_t totalInstrs() const { return index_.totalInstrs(); }
+    // Instruction number of the next record returned
+    uint64_t position() const;
+
+private:
+    void schedule();
+    bool advance();
+    void drain();
+
+    int fd_ = -1;
+    ChunkIndex index_;
+    Options options_;
+    std::unique_ptr<openzl::training::ThreadPool> pool_;
+    // Frame and chunk buffers; outlives the ones in pending_ and current_
+    BufferPool buffers_;
+
+    std::deque<std::future<PooledBuffer>> pending_;
+    size_t nextSchedule_ = 0;  // next chunk to hand to the pool
+    size_t currentChunk_ = 0;  // chunk backing current_
+    PooledBuffer current_;
+    size_t cursor_ = 0;  // next record in current_
+    size_t available_ = 0;
+};
+
+extern template class BasicTraceReader<ChampSimFormat>;
+extern template class BasicTraceReader<CloudSuiteFormat>;
+
+using TraceReader = BasicTraceReader<ChampSimFormat>;
+using CloudSuiteTraceReader = BasicTraceReader<CloudSuiteFormat>;
+
+}  // namespace tracezl
@@ -1,38 +1,182 @@
 #include "tools/training/train.h"
 
+#include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <future>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <stdexcept>
+#include <vector>
 
+#include "buffer_pool.h"
 #include "common.h"
 #include "compressor.h"
+#include "io.h"
+#include "levels.h"
+#include "openzl/zl_compress.h"
 #include "tools/io/InputSetBuilder.h"
+#include "tools/training/utils/thread_pool.h"
 
 // Removed using namespace directives
 
-void train_compressor(const std::string& trace_path, const std::string& config_path,
-                      size_t num_threads) {
-    std::cout << "Training compressor on " << trace_path << " with " << num_threads << " threads..."
-              << std::endl;
+namespace {
+
+// One training sample: a chunk-sized range of one input trace
+struct Sample {
+    size_t file;
+    uint64_t offset;
+    size_t size;
+};
+
+// Pick `numSamples` chunks spread evenly over the concatenation of all
+// inputs, on the same chunk grid compress_trace uses
+std::vector<Sample> planSamples(const std::vector<uint64_t>& fileSizes, size_t chunkBytes,
+                                size_t recordSize, size_t numSamples) {
+    std::vector<uint64_t> firstChunk;  // first global chunk number of each file
+    uint64_t numChunks = 0;
+    for (uint64_t size : fileSizes) {
+        firstChunk.push_back(numChunks);
+        numChunks += (size + chunkBytes - 1) / chunkBytes;
+    }
+    numSamples = std::min<uint64_t>(numSamples, numChunks);
+
+    std::vector<Sample> samples;
+    for (size_t i = 0; i < numSamples; ++i) {
+        // Middle of the i-th of numSamples equal strata
+        const uint64_t chunk = (2 * i + 1) * numChunks / (2 * numSamples);
+        const size_t file =
+            std::upper_bound(firstChunk.begin(), firstChunk.end(), chunk) - firstChunk.begin() - 1;
+        const uint64_t offset = (chunk - firstChunk[file]) * chunkBytes;
+        const uint64_t size = std::min<uint64_t>(chunkBytes, fileSizes[file] - offset);
+
+        // A trailing partial record is not a record the compressor will see
+        const size_t whole = size / recordSize * recordSize;
+        if (whole > 0) samples.push_back({file, offset, whole});
+    }
+    return samples;
+}
+
+// Compress every staged sample with one frontier point to measure its ratio
+// and single-threaded speed. Samples run in parallel but each is timed on its
+// own, so the speed does not depend on the thread count.
+tracezl::ConfigLevel measureLevel(std::string config, tracezl::TraceFormat format,
+                                  const std::vector<std::string>& samplePaths,
+                                  openzl::training::ThreadPool& pool,
+                                  tracezl::BufferPool& buffers) {
+    auto compressor = tracezl::createCompressorFromSerialized(config, format);
+    compressor->setParameter(openzl::CParam::FormatVersion, ZL_MAX_FORMAT_VERSION);
+
+    struct SampleCost {
+        uint64_t bytes;
+        uint64_t compressed;
+        uint64_t nanos;
+    };
+    std::vector<std::future<SampleCost>> futures;
+    for (const std::string& path : samplePaths) {
+        futures.push_back(pool.run([&, path]() {
+            std::ifstream file(path, std::ios::binary);
+            const std::string sample((std::istreambuf_iterator<char>(file)),
+                                     std::istreambuf_iterator<char>());
+            const auto start = std::chrono::steady_clock::now();
+            const tracezl::PooledBuffer frame =
+                tracezl::compressChunk(*compressor, sample.data(), sample.size(), buffers);
+            const auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start);
+            return SampleCost{sample.size(), frame.size(), (uint64_t)nanos.count()};
+        }));
+    }
+
+    tracezl::ConfigLevel level = {.config = std::move(config)};
+    for (auto& future : futures) {
+        const SampleCost cost = future.get();
+        level.sampleBytes += cost.bytes;
+        level.compressedBytes += cost.compressed;
+        level.compressNanos += cost.nanos;
+    }
+    return level;
+}
+
+}  // namespace
 
-    // Prepare input
-    // We use InputSetBuilder to load the file
+void train_compressor(const std::vector<std::string>& trace_paths, const std::string& config_path,
+                      const TrainOptions& options) {
+    std::cout << "Training compressor on " << trace_paths.size() << " "
+              << tracezl::formatName(options.format) << " trace(s) with " << options.num_threads
+              << " threads..." << std::endl;
+
+    // Training on whole multi-GB traces costs memory and time in proportion
+    // to the trace, and tunes for one huge input. Instead train on a bounded
+    // number of chunks of the size compress_trace actually encodes.
+    const size_t recordSize = tracezl::recordSize(options.format);
+    const size_t chunkBytes = std::max<size_t>(options.chunk_size / recordSize, 1) * recordSize;
+    size_t numSamples = std::max<size_t>(options.num_samples, 1);
+    if (options.max_memory) {
+        numSamples = std::min(numSamples, std::max<size_t>(options.max_memory / chunkBytes, 1));
+    }
+
+    std::vector<std::ifstream> files;
+    std::vector<uint64_t> fileSizes;
+    uint64_t totalSize = 0;
+    for (const std::string& path : trace_paths) {
+        files.emplace_back(path, std::ios::binary | std::ios::ate);
+        if (!files.back()) throw std::runtime_error("Cannot open trace file " + path);
+        fileSizes.push_back(files.back().tellg());
+        totalSize += fileSizes.back();
+    }
+
+    const std::vector<Sample> samples = planSamples(fileSizes, chunkBytes, recordSize, numSamples);
+    if (samples.empty()) throw std::runtime_error("No whole records to train on");
+
+    // Samples are staged one at a time into a private directory that the
+    // InputSetBuilder then loads
+    tracezl::TempDir sampleDir;
+    std::vector<std::string> samplePaths;
     openzl::tools::io::InputSetBuilder builder(true);
-    builder.add_path(trace_path);
+    std::string buffer;
+    uint64_t sampledBytes = 0;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        const Sample& sample = samples[i];
+        buffer.resize(sample.size);
+        std::ifstream& file = files[sample.file];
+        file.clear();
+        file.seekg(sample.offset);
+        file.read(buffer.data(), buffer.size());
+        if ((size_t)file.gcount() != buffer.size()) {
+            throw std::runtime_error("Unexpected EOF sampling " + trace_paths[sample.file]);
+        }
+
+        const std::string samplePath = sampleDir.path() + "/sample" + std::to_string(i);
+        std::ofstream out(samplePath, std::ios::binary);
+        out.write(buffer.data(), buffer.size());
+        if (!out) throw std::runtime_error("Failed to write training sample " + samplePath);
+        builder.add_path(samplePath);
+        samplePaths.push_back(samplePath);
+        sampledBytes += sample.size;
+    }
+    buffer = std::string();
+    std::cout << "Sampled " << samples.size() << " chunks (" << (sampledBytes >> 20) << " of "
+              << (totalSize >> 20) << " MB)" << std::endl;
+
     auto inputs = std::move(builder).build();
 
     // Prepare base compressor
     openzl::Compressor compressor;
-    ZL_GraphID startGraph = tracezl::registerGraph(compressor);
+    ZL_GraphID startGraph = tracezl::registerGraph(compressor, options.format);
 
     // Select starting graph
     openzl::unwrap(ZL_Compressor_selectStartingGraphID(compressor.get(), startGraph),
                    "Failed to select starting graph");
 
     // Train Params
+    const tracezl::TraceFormat format = options.format;
     openzl::training::TrainParams params = {
-        .compressorGenFunc = tracezl::createCompressorFromSerialized,
-        .threads = (uint32_t)num_threads,
+        .compressorGenFunc =
+            [format](openzl::poly::string_view serialized) {
+                return tracezl::createCompressorFromSerialized(serialized, format);
+            },
+        .threads = (uint32_t)options.num_threads,
         .noClustering = true,
         .paretoFrontier = true};
 
@@ -46,11 +190,34 @@ void train_compressor(const std::string& trace_path, const std::string& config_p
         throw std::runtime_error("Training failed to produce any compressor");
     }
 
+    // Every frontier point becomes a level, measured on the same samples.
+    // Levels are numbered by ratio, which repeats between runs; the timings
+    // do not.
+    std::cout << "Measuring " << result.size() << " frontier point(s)..." << std::endl;
+    openzl::training::ThreadPool pool(options.num_threads);
+    tracezl::BufferPool buffers;
+    std::vector<tracezl::ConfigLevel> levels;
+    for (const auto& point : result) {
+        levels.push_back(measureLevel(std::string(*point), format, samplePaths, pool, buffers));
+    }
+    std::stable_sort(levels.begin(), levels.end(), [](const auto& a, const auto& b) {
+        return a.compressedBytes > b.compressedBytes;
+    });
+
+    std::cout << std::left << std::setw(8) << "level" << std::right << std::setw(9) << "ratio"
+              << std::setw(13) << "comp MB/s" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    for (size_t i = 0; i < levels.size(); ++i) {
+        std::cout << std::left << std::setw(8) << i << std::right << std::setw(9)
+                  << levels[i].ratio() << std::setw(13) << levels[i].compressMBps() << std::endl;
+    }
+
     // Save result
     std::ofstream out(config_path, std::ios::binary);
     if (!out) throw std::runtime_error("Cannot open output config file");
-    out << *result[0];
+    out << tracezl::serializeLevels(levels);
     out.close();
 
-    std::cout << "Training complete. Config saved to " << config_path << std::endl;
+    std::cout << "Training complete. " << levels.size() << " level(s) saved to " << config_path
+              << std::endl;
 }
@@ -0,0 +1,306 @@
+#include "transpose.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define TRACEZL_X86_64 1
+// Kernels are compiled for their instruction set one function at a time, so
+// the rest of the binary keeps the baseline target
+#define TRACEZL_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TRACEZL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace tracezl {
+
+namespace {
+
+uint64_t load64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+std::atomic<SimdLevel>& activeLevel() {
+    static std::atomic<SimdLevel> level{detectSimdLevel()};
+    return level;
+}
+
+template <class Format>
+RegCounts gatherScalar(const uint8_t* records, size_t begin, size_t numInstrs,
+                       const GatherColumns& out, RegCounts n) {
+    using T = RecordTranspose<Format>;
+    for (size_t i = begin; i < numInstrs; ++i) {
+        const uint8_t* const r = records + i * T::kRecordSize;
+        unsigned occ = 0;
+
+        out.ips[i] = load64(r + Format::kIp);
+        out.isBranch[i] = r[Format::kIsBranch];
+        out.taken[i] = r[Format::kBranchTaken];
+        for (unsigned s = 0; s < T::kSlots; ++s) {
+            occ |= unsigned(load64(r + Format::kDestMem + 8 * s) != 0) << (T::kOccDestMem + s);
+        }
+        // Every register is stored and only the cursor skips empty ones, so
+        // there is no branch on the data
+        for (unsigned s = 0; s < T::kDest; ++s) {
+            const uint8_t reg = r[Format::kDestRegs + s];
+            out.destRegs[n.dest] = reg;
+            n.dest += reg != 0;
+            occ |= unsigned(reg != 0) << (T::kOccDestRegs + s);
+        }
+        for (unsigned s = 0; s < T::kSource; ++s) {
+            const uint8_t reg = r[Format::kSourceRegs + s];
+            out.srcRegs[n.source] = reg;
+            n.source += reg != 0;
+            occ |= unsigned(reg != 0) << (T::kOccSourceRegs + s);
+        }
+        out.occupancy[i] = occ;
+    }
+    return n;
+}
+
+template <class Format>
+void scatterScalar(const ScatterColumns& in, size_t begin, size_t numInstrs, uint8_t* records,
+                   RegCounts n) {
+    using T = RecordTranspose<Format>;
+    for (size_t i = begin; i < numInstrs; ++i) {
+        uint8_t* const r = records + i * T::kRecordSize;
+        const unsigned occ = in.occupancy[i];
+
+        r[Format::kIsBranch] = in.isBranch[i];
+        r[Format::kBranchTaken] = in.taken[i];
+        for (unsigned s = 0; s < T::kDest; ++s) {
+            const bool present = occ >> (T::kOccDestRegs + s) & 1;
+            r[Format::kDestRegs + s] = present ? in.destRegs[n.dest] : 0;
+            n.dest += present;
+        }
+        for (unsigned s = 0; s < T::kSource; ++s) {
+            const bool present = occ >> (T::kOccSourceRegs + s) & 1;
+            r[Format::kSourceRegs + s] = present ? in.srcRegs[n.source] : 0;
+            n.source += present;
+        }
+    }
+}
+
+#ifdef TRACEZL_X86_64
+
+// pshufb controls for a group of `kWidth` slots starting at lane `kFirst`,
+// indexed by the group's occupancy. `pack` moves the occupied lanes to the
+// front, `unpack` moves leading lanes back to the occupied slots. Lanes
+// with the high bit set are zeroed.
+template <unsigned kWidth, unsigned kFirst>
+struct ShuffleTable {
+    alignas(16) uint8_t pack[1 << kWidth][16];
+    alignas(16) uint8_t unpack[1 << kWidth][16];
+    uint8_t count[1 << kWidth];
+
+    constexpr ShuffleTable() : pack(), unpack(), count() {
+        for (unsigned mask = 0; mask < (1u << kWidth); ++mask) {
+            unsigned kept = 0;
+            for (unsigned lane = 0; lane < 16; ++lane) unpack[mask][lane] = 0x80;
+            for (unsigned s = 0; s < kWidth; ++s) {
+                if (mask >> s & 1) {
+                    unpack[mask][kFirst + s] = kept;
+                    pack[mask][kept++] = kFirst + s;
+                }
+            }
+            for (unsigned lane = kept; lane < 16; ++lane) pack[mask][lane] = 0x80;
+            count[mask] = kept;
+        }
+    }
+};
+
+template <unsigned kWidth, unsigned kFirst>
+constexpr ShuffleTable<kWidth, kFirst> kShuffle{};
+
+TRACEZL_TARGET_SSE41 inline __m128i load128(const void* p) {
+    return _mm_loadu_si128((const __m128i*)p);
+}
+
+// Bits of the non-zero memory slots of a record, two slots per compare
+template <class Format>
+TRACEZL_TARGET_SSE41 inline unsigned memBitsSse41(const uint8_t* r) {
+    using T = RecordTranspose<Format>;
+    unsigned zero = 0;
+    for (unsigned s = 0; s < T::kSlots; s += 2) {
+        const __m128i slots = load128(r + Format::kDestMem + 8 * s);
+        const __m128i isZero = _mm_cmpeq_epi64(slots, _mm_setzero_si128());
+        zero |= unsigned(_mm_movemask_pd(_mm_castsi128_pd(isZero))) << s;
+    }
+    return ~zero & ((1u << T::kSlots) - 1);
+}
+
+// Same, four slots per compare
+template <class Format>
+TRACEZL_TARGET_AVX2 inline unsigned memBitsAvx2(const uint8_t* r) {
+    using T = RecordTranspose<Format>;
+    unsigned zero = 0;
+    unsigned s = 0;
+    for (; s + 4 <= T::kSlots; s += 4) {
+        const __m256i slots = _mm256_loadu_si256((const __m256i*)(r + Format::kDestMem + 8 * s));
+        const __m256i isZero = _mm256_cmpeq_epi64(slots, _mm256_setzero_si256());
+        zero |= unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(isZero))) << s;
+    }
+    if (s < T::kSlots) {
+        const __m128i slots = load128(r + Format::kDestMem + 8 * s);
+        const __m128i isZero = _mm_cmpeq_epi64(slots, _mm_setzero_si128());
+        zero |= unsigned(_mm_movemask_pd(_mm_castsi128_pd(isZero))) << s;
+    }
+    return ~zero & ((1u << T::kSlots) - 1);
+}
+
+// Gather record `i` given its memory occupancy. Stores 16 bytes at each
+// register cursor.
+template <class Format>
+TRACEZL_TARGET_SSE41 inline void gatherRecordSse41(const uint8_t* r, size_t i, unsigned memBits,
+                                                   const GatherColumns& out, RegCounts& n) {
+    using T = RecordTranspose<Format>;
+    constexpr auto& dest = kShuffle<T::kDest, 0>;
+    constexpr auto& source = kShuffle<T::kSource, T::kDest>;
+
+    const __m128i regs = load128(r + Format::kDestRegs);
+    const unsigned zero = _mm_movemask_epi8(_mm_cmpeq_epi8(regs, _mm_setzero_si128()));
+    const unsigned regBits = ~zero & ((1u << T::kSlots) - 1);
+    const unsigned destBits = regBits & ((1u << T::kDest) - 1);
+    const unsigned sourceBits = regBits >> T::kDest;
+
+    out.ips[i] = load64(r + Format::kIp);
+    out.isBranch[i] = r[Format::kIsBranch];
+    out.taken[i] = r[Format::kBranchTaken];
+    out.occupancy[i] = memBits << T::kOccDestMem | regBits << T::kOccDestRegs;
+    _mm_storeu_si128((__m128i*)(out.destRegs + n.dest),
+                     _mm_shuffle_epi8(regs, load128(dest.pack[destBits])));
+    _mm_storeu_si128((__m128i*)(out.srcRegs + n.source),
+                     _mm_shuffle_epi8(regs, load128(source.pack[sourceBits])));
+    n.dest += dest.count[destBits];
+    n.source += source.count[sourceBits];
+}
+
+// The vector loops run while a 16-byte store at both register cursors stays
+// inside the arrays, and leave the last records to the scalar loop
+template <class Format>
+TRACEZL_TARGET_SSE41 RegCounts gatherSse41(const uint8_t* records, size_t numInstrs,
+                                           const GatherColumns& out) {
+    using T = RecordTranspose<Format>;
+    const size_t destEnd = numInstrs * T::kDest;
+    const size_t sourceEnd = numInstrs * T::kSource;
+    RegCounts n;
+    size_t i = 0;
+    for (; i < numInstrs && n.dest + 16 <= destEnd && n.source + 16 <= sourceEnd; ++i) {
+        const uint8_t* const r = records + i * T::kRecordSize;
+        gatherRecordSse41<Format>(r, i, memBitsSse41<Format>(r), out, n);
+    }
+    return gatherScalar<Format>(records, i, numInstrs, out, n);
+}
+
+template <class Format>
+TRACEZL_TARGET_AVX2 RegCounts gatherAvx2(const uint8_t* records, size_t numInstrs,
+                                         const GatherColumns& out) {
+    using T = RecordTranspose<Format>;
+    const size_t destEnd = numInstrs * T::kDest;
+    const size_t sourceEnd = numInstrs * T::kSource;
+    RegCounts n;
+    size_t i = 0;
+    for (; i < numInstrs && n.dest + 16 <= destEnd && n.source + 16 <= sourceEnd; ++i) {
+        const uint8_t* const r = records + i * T::kRecordSize;
+        gatherRecordSse41<Format>(r, i, memBitsAvx2<Format>(r), out, n);
+    }
+    return gatherScalar<Format>(records, i, numInstrs, out, n);
+}
+
+// Loads 16 bytes at each register cursor, so it stops while both loads stay
+// inside the register streams
+template <class Format>
+TRACEZL_TARGET_SSE41 void scatterSse41(const ScatterColumns& in, size_t numInstrs,
+                                       uint8_t* records) {
+    using T = RecordTranspose<Format>;
+    constexpr auto& dest = kShuffle<T::kDest, 0>;
+    constexpr auto& source = kShuffle<T::kSource, T::kDest>;
+
+    RegCounts n;
+    size_t i = 0;
+    for (; i < numInstrs && n.dest + 16 <= in.numDestRegs && n.source + 16 <= in.numSrcRegs;
+         ++i) {
+        uint8_t* const r = records + i * T::kRecordSize;
+        // Masked on both sides: bits past the last slot would index past the
+        // shuffle tables
+        const unsigned regBits = in.occupancy[i] >> T::kOccDestRegs;
+        const unsigned destBits = regBits & ((1u << T::kDest) - 1);
+        const unsigned sourceBits = regBits >> T::kDest & ((1u << T::kSource) - 1);
+
+        r[Format::kIsBranch] = in.isBranch[i];
+        r[Format::kBranchTaken] = in.taken[i];
+        const __m128i regs = _mm_or_si128(
+            _mm_shuffle_epi8(load128(in.destRegs + n.dest), load128(dest.unpack[destBits])),
+            _mm_shuffle_epi8(load128(in.srcRegs + n.source), load128(source.unpack[sourceBits])));
+        const uint64_t slots = _mm_cvtsi128_si64(regs);
+        std::memcpy(r + Format::kDestRegs, &slots, T::kSlots);
+        n.dest += dest.count[destBits];
+        n.source += source.count[sourceBits];
+    }
+    scatterScalar<Format>(in, i, numInstrs, records, n);
+}
+
+#endif  // TRACEZL_X86_64
+
+}  // namespace
+
+SimdLevel detectSimdLevel() {
+#ifdef TRACEZL_X86_64
+    static const SimdLevel level = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+        if (__builtin_cpu_supports("sse4.1")) return SimdLevel::SSE41;
+        return SimdLevel::Scalar;
+    }();
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel simdLevel() { return activeLevel().load(std::memory_order_relaxed); }
+
+void setSimdLevel(SimdLevel level) {
+    activeLevel().store(std::min(level, detectSimdLevel()), std::memory_order_relaxed);
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX2:
+            return "avx2";
+        case SimdLevel::SSE41:
+            return "sse4.1";
+        case SimdLevel::Scalar:
+        default:
+            return "scalar";
+    }
+}
+
+template <class Format>
+RegCounts RecordTranspose<Format>::gather(SimdLevel level, const uint8_t* records,
+                                          size_t numInstrs, const GatherColumns& out) {
+#ifdef TRACEZL_X86_64
+    if (level == SimdLevel::AVX2) return gatherAvx2<Format>(records, numInstrs, out);
+    if (level == SimdLevel::SSE41) return gatherSse41<Format>(records, numInstrs, out);
+#endif
+    return gatherScalar<Format>(records, 0, numInstrs, out, {});
+}
+
+template <class Format>
+void RecordTranspose<Format>::scatter(SimdLevel level, const ScatterColumns& in,
+                                      size_t numInstrs, uint8_t* records) {
+#ifdef TRACEZL_X86_64
+    // Unpacking at most eight registers fits one 128-bit shuffle, so AVX2
+    // has nothing to add here
+    if (level != SimdLevel::Scalar) return scatterSse41<Format>(in, numInstrs, records);
+#endif
+    scatterScalar<Format>(in, 0, numInstrs, records, {});
+}
+
+template struct RecordTranspose<ChampSimFormat>;
+template struct RecordTranspose<CloudSuiteFormat>;
+
+}  // namespace tracezl
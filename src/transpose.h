@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "trace_format.h"
+
+namespace tracezl {
+
+// Instruction sets the record transpose kernels are built for
+enum class SimdLevel { Scalar, SSE41, AVX2 };
+
+// Best level this CPU runs, checked once
+SimdLevel detectSimdLevel();
+// Level the field splitter uses: detectSimdLevel() unless lowered with
+// setSimdLevel(). A level above the detected one is clamped.
+SimdLevel simdLevel();
+void setSimdLevel(SimdLevel level);
+const char* simdLevelName(SimdLevel level);
+
+// Per-record columns gathered out of records. The register arrays receive
+// only the non-zero slots, in record order, and must hold numInstrs * slots
+// bytes as the kernels write past the kept ones.
+struct GatherColumns {
+    uint64_t* ips;  // raw IPs, before any value model
+    uint8_t* isBranch;
+    uint8_t* taken;
+    uint16_t* occupancy;
+    uint8_t* destRegs;
+    uint8_t* srcRegs;
+};
+
+// Columns scattered back into records
+struct ScatterColumns {
+    const uint8_t* isBranch;
+    const uint8_t* taken;
+    const uint16_t* occupancy;
+    const uint8_t* destRegs;
+    size_t numDestRegs;
+    const uint8_t* srcRegs;
+    size_t numSrcRegs;
+};
+
+struct RegCounts {
+    size_t dest = 0;
+    size_t source = 0;
+};
+
+// Array-of-structs <-> struct-of-arrays moves of the field splitter for one
+// record layout. Memory slots go through the stride predictor one at a time,
+// so the kernels only find which are occupied and leave them to the caller.
+template <class Format>
+struct RecordTranspose {
+    static constexpr size_t kRecordSize = sizeof(typename Format::Record);
+    static constexpr size_t kDest = Format::kDestSlots;
+    static constexpr size_t kSource = Format::kSourceSlots;
+    static constexpr size_t kSlots = kDest + kSource;
+
+    // Occupancy bitmap of one record: bit set when the slot is non-zero
+    static constexpr unsigned kOccDestMem = 0;
+    static constexpr unsigned kOccSourceMem = kOccDestMem + kDest;
+    static constexpr unsigned kOccDestRegs = kOccSourceMem + kSource;
+    static constexpr unsigned kOccSourceRegs = kOccDestRegs + kDest;
+    static_assert(kOccSourceRegs + kSource <= 16, "occupancy must fit in 16 bits");
+
+    // The kernels test all register slots with one 16-byte load and memory
+    // slots two or four at a time
+    static_assert(Format::kSourceRegs == Format::kDestRegs + kDest, "registers not contiguous");
+    static_assert(Format::kSourceMem == Format::kDestMem + 8 * kDest, "addresses not contiguous");
+    static_assert(Format::kDestRegs + 16 <= kRecordSize, "register load leaves the record");
+    static_assert(kSlots <= 8 && kSlots % 2 == 0, "unsupported slot count");
+
+    // Gather the IP, branch bytes and occupancy bitmap of every record and
+    // pack its non-zero registers. Returns the number of registers kept.
+    static RegCounts gather(SimdLevel level, const uint8_t* records, size_t numInstrs,
+                            const GatherColumns& out);
+    // Write the branch bytes and register slots of every record, zero for
+    // empty slots. Other bytes are left alone. The register counts must match
+    // the occupancy bitmaps.
+    static void scatter(SimdLevel level, const ScatterColumns& in, size_t numInstrs,
+                        uint8_t* records);
+};
+
+}  // namespace tracezl
@@ -0,0 +1,117 @@
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "checksum.h"
+#include "columnar.h"
+#include "compressor.h"
+#include "container.h"
+#include "io.h"
+#include "tools/training/utils/thread_pool.h"
+
+void verify_archive(const std::string& compressed_path, size_t num_threads) {
+    std::cout << "Verifying " << compressed_path << " with " << num_threads << " threads..."
+              << std::endl;
+
+    // Frames are decoded straight out of a mapping, so the archive must be a file
+    if (!tracezl::isRegularFile(compressed_path)) {
+        throw std::runtime_error("verify needs an archive file, not a pipe");
+    }
+    std::ifstream compFile(compressed_path, std::ios::binary | std::ios::ate);
+    if (!compFile) throw std::runtime_error("Cannot open compressed file");
+    size_t compFileSize = compFile.tellg();
+
+    std::vector<std::string> problems;
+    const tracezl::ArchiveHeader header = tracezl::readArchiveHeader(compFile, compFileSize);
+    if ((header.flags & tracezl::ARCHIVE_EMBEDDED_CONFIG) &&
+        tracezl::xxh64(header.config.data(), header.config.size()) != header.configHash) {
+        problems.push_back("Embedded config does not match its hash");
+    }
+
+    // A damaged index is reported, and the frames are still scanned and checked
+    std::optional<tracezl::ChunkIndex> index;
+    bool indexDamaged = false;
+    try {
+        index = tracezl::readChunkIndex(compFile, compFileSize);
+    } catch (const std::exception& e) {
+        problems.push_back(e.what());
+        indexDamaged = true;
+    }
+    const bool scanned = !index;
+    if (scanned) {
+        // Every archive is written with an index
+        if (!indexDamaged) {
+            problems.push_back("No chunk index: the trailer is missing or damaged");
+        }
+        std::cout << "No chunk index found, scanning frames..." << std::endl;
+        index = tracezl::scanChunkIndex(compFile, compFileSize);
+    }
+    if (scanned) {
+        std::cout << "Warning: chunk checksums are lost with the index; only checking that "
+                     "every frame decodes"
+                  << std::endl;
+    }
+    if (header.numInstrs != tracezl::kUnknownInstrs && header.numInstrs != index->totalInstrs()) {
+        problems.push_back("Header holds " + std::to_string(header.numInstrs) +
+                           " instructions but the index " +
+                           std::to_string(index->totalInstrs()));
+    }
+
+    tracezl::MappedFile input(compressed_path);
+
+    // Thread Pool. Every chunk is decoded into a pooled buffer, checked and
+    // dropped; a failed chunk reports why instead of stopping the scan.
+    tracezl::BufferPool buffers;
+    openzl::training::ThreadPool pool(num_threads);
+    std::vector<std::future<std::optional<std::string>>> futures;
+    futures.reserve(index->size());
+    const tracezl::TraceFormat format = index->format();
+
+    for (size_t chunk = 0; chunk < index->size(); ++chunk) {
+        const tracezl::ChunkIndexEntry& entry = (*index)[chunk];
+        futures.push_back(pool.run([&, chunk, entry]() -> std::optional<std::string> {
+            if (entry.compressedSize > input.size() ||
+                entry.compressedOffset > input.size() - entry.compressedSize) {
+                return "frame ends past the archive";
+            }
+            try {
+                const tracezl::PooledBuffer decoded = tracezl::decodeChunk(
+                    format, tracezl::kAllFields, input.data() + entry.compressedOffset,
+                    entry.compressedSize, buffers);
+                if (decoded.size() != entry.uncompressedSize) {
+                    return "decoded " + std::to_string(decoded.size()) + " bytes, index says " +
+                           std::to_string(entry.uncompressedSize);
+                }
+                if (!index->checksumMatches(chunk, decoded.data(), decoded.size())) {
+                    return std::string("checksum mismatch");
+                }
+            } catch (const std::exception& e) {
+                return std::string(e.what());
+            }
+            return std::nullopt;
+        }));
+    }
+
+    size_t badChunks = 0;
+    for (size_t i = 0; i < futures.size(); ++i) {
+        if (auto problem = futures[i].get()) {
+            std::cout << "\rChunk " << i << " at offset " << (*index)[i].compressedOffset << ": "
+                      << *problem << std::endl;
+            ++badChunks;
+        }
+        std::cout << "\rVerified: " << ((i + 1) * 100 / futures.size()) << "%" << std::flush;
+    }
+    std::cout << std::endl;
+
+    for (const std::string& problem : problems) std::cout << problem << std::endl;
+    if (badChunks || !problems.empty()) {
+        throw std::runtime_error(std::to_string(badChunks) + " of " +
+                                 std::to_string(index->size()) + " chunks failed verification");
+    }
+    std::cout << "All " << index->size() << " chunks (" << index->totalInstrs()
+              << " instructions) verified." << std::endl;
+}